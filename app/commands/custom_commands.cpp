@@ -61,6 +61,12 @@ static void handleIoData(uint32_t arg) {
     DEBUG_PRINT("COMMAND_IO_DATA %x\n", arg);
 }
 
+static void handleGetCardProfile(uint32_t) {
+    DEBUG_PRINT("GET_CARD_PROFILE\n");
+    needFileCheckAction = picostation::FileListingStates::GET_CARD_PROFILE;
+    listReadyState = 0;
+}
+
 static void handleBootloader(uint32_t arg) {
     if (arg == 0xBEEF) {
         rom_reset_usb_boot_extra(Pin::LED, 0, false);
@@ -107,6 +113,7 @@ static const CustomCommandHandler kCustomHandlers[] = {
     { picostation::COMMAND_MOUNT_FILE,    "COMMAND_MOUNT_FILE",    "Mount the file indexed by the provided argument", handleMountFile },
     { picostation::COMMAND_IO_COMMAND,    "COMMAND_IO_COMMAND",    "Begin a metadata IO transaction (e.g. game ID transfer)", handleIoCommand },
     { picostation::COMMAND_IO_DATA,       "COMMAND_IO_DATA",       "Send a 16-bit payload for the active metadata IO transaction", handleIoData },
+    { picostation::COMMAND_GET_CARD_PROFILE,"COMMAND_GET_CARD_PROFILE","Send the SD card speed profile taken at mount in place of the next listing", handleGetCardProfile },
     { picostation::COMMAND_BOOTLOADER,    "COMMAND_BOOTLOADER",    "Reboot the RP2040 into the USB bootloader when armed", handleBootloader },
     { picostation::COMMAND_FW_UPDATE,    "COMMAND_FW_UPDATE",    "Reboot the RP2040 into the USB bootloader when armed", handleFirmwareUpdate },
 };
@@ -13,6 +13,7 @@ enum CUSTOM_CMD {
     COMMAND_MOUNT_FILE     = 0x5,
     COMMAND_IO_COMMAND     = 0x6,
     COMMAND_IO_DATA        = 0x7,
+    COMMAND_GET_CARD_PROFILE = 0x8,
     COMMAND_BOOTLOADER     = 0xA,
     COMMAND_FW_UPDATE       = 0xB
 };
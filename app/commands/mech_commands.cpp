@@ -57,6 +57,7 @@ void __time_critical_func(picostation::MechCommand::processLatchedCommand)()
 				}
 				
 				g_driveMechanics.stopSled();
+				m_i2s.postSeekHint(g_driveMechanics.getSector());
 				sled_break = 1;
 				prev_dir = dir;
 			}
@@ -108,6 +109,7 @@ void __time_critical_func(picostation::MechCommand::processLatchedCommand)()
 
 	            case picostation::MechCommand::ASEQ_CMD_2NTRK_JUMP:
 	            	g_driveMechanics.setSector(m_jumpTrack << 1, command.aseq_cmd.dir);
+					m_i2s.postSeekHint(g_driveMechanics.getSector());
 					break;
 			}
 			break;
@@ -73,6 +73,13 @@ class listingBuilder {
         return nullptr;
     }
 
+    // Raw payload in place of a listing, for replies that aren't directory entries
+    void setData(const uint8_t* data, uint32_t size) {
+        clear();
+        mSize = size < LISTING_SIZE ? size : LISTING_SIZE;
+        memcpy(mValuesContainer, data, mSize);
+    }
+
     void clear() {
         mSize = 0;
         memset(mValuesContainer, 0, LISTING_SIZE);
@@ -0,0 +1,52 @@
+// spsc_queue.h - Lock-free single-producer/single-consumer ring, safe across cores and IRQ context.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/sync.h"
+
+namespace picostation {
+// Each index is written by one side only and read by the other, so plain word stores are enough.
+// The barriers keep slot contents and index updates in order for the other core and the DMA.
+template <typename T, size_t N>
+class SPSCQueue {
+    static_assert(N && (N & (N - 1)) == 0, "SPSCQueue size must be a power of two");
+
+  public:
+    SPSCQueue() {};
+
+    // Producer: fill the slot returned by back(), then publish it with push()
+    T *back() { return full() ? nullptr : &m_items[m_tail & (N - 1)]; }
+    void push()
+    {
+        __dmb();
+        m_tail = m_tail + 1;
+    }
+
+    // Consumer: read the slot returned by front(), then release it with pop()
+    T *front()
+    {
+        if (empty())
+        {
+            return nullptr;
+        }
+        __dmb();
+        return &m_items[m_head & (N - 1)];
+    }
+    void pop()
+    {
+        __dmb();
+        m_head = m_head + 1;
+    }
+
+    bool empty() const { return m_head == m_tail; }
+    bool full() const { return m_tail - m_head == N; }
+    size_t size() const { return m_tail - m_head; }
+
+  private:
+    T m_items[N];
+    volatile uint32_t m_head = 0;  // Written by the consumer
+    volatile uint32_t m_tail = 0;  // Written by the producer
+};
+}  // namespace picostation
@@ -60,15 +60,17 @@ enum : unsigned int {
 }
 
 namespace PIOInstance {
-PIO const I2S_DATA = pio0;
+PIO const I2S_DATA = pio1;
 PIO const MECHACON = pio0;
 PIO const SOCT = pio0;
 PIO const SUBQ = pio0;
 }  // namespace PIOInstance
 
 namespace SM {
-// PIO0
+// PIO1
 constexpr uint32_t I2S_DATA = 0;
+// SM 1 clocks SD data blocks when sd_spi.c is built with SD_PIO_SPI
+// PIO0
 constexpr uint32_t MECHACON = 1;
 constexpr uint32_t SOCT = 2;
 constexpr uint32_t SUBQ = 3;
@@ -9,6 +9,7 @@
 #include <string.h>
 #include <array>
 #include "ff.h"
+#include "diskio.h"
 #include "commons/logging.h"
 #include "picostation.h"
 #include "emulation/subq.h"
@@ -74,6 +75,18 @@ static constexpr uint16_t crc16_lut[256] =
 
 static uint8_t s_userData[c_cdSamplesBytes] = {0};
 
+// Every SD block a 2352-byte sector can touch, so one sector costs one multi-block read
+static constexpr size_t c_stageBlocks = (c_cdSamplesBytes + 511) / 512 + 1;
+static uint8_t s_stageBuffer[c_stageBlocks * 512] __attribute__((aligned(4)));
+
+// Partial blocks of the streams not on the stage right now, a data track and a CDDA file taking
+// turns each pick up their own instead of reading it again
+static constexpr size_t c_parkedBlocks = 2;
+static uint8_t s_parkBuffer[c_parkedBlocks * 512] __attribute__((aligned(4)));
+static LBA_t s_parkSectors[c_parkedBlocks];
+
+static FSTAGE s_stage = {s_stageBuffer, c_stageBlocks, 0, 0, s_parkBuffer, s_parkSectors, c_parkedBlocks, 0};
+
 namespace {
 constexpr size_t kCdSectorSize = c_cdSamplesBytes;
 constexpr size_t kCdUserDataOffset = 24;
@@ -162,9 +175,8 @@ static void __time_critical_func(getParentPath)(const TCHAR *path, TCHAR *parent
     }
 }
 
-void __time_critical_func(picostation::DiscImage::buildSector)(const int sector, uint32_t *buffer, uint16_t *userData, const uint16_t *scramling)
+void __time_critical_func(picostation::DiscImage::buildSector)(const int sector, uint16_t *buffer, uint16_t *userData, const uint16_t *scramling)
 {
-	uint32_t tmp;
 	static uint8_t header[24] =
 	{
 		// Sync - 12 bytes
@@ -187,42 +199,17 @@ void __time_critical_func(picostation::DiscImage::buildSector)(const int sector,
 	
 	for (int i = 0; i < 12; i++)
 	{
-		tmp = (src[i] ^ scramling[i]) << 8;
-		
-		if (tmp & 0x100)
-		{
-			tmp |= 0xFF;
-		}
-		
-		buffer[i] = tmp;
+		buffer[i] = src[i] ^ scramling[i];
 	}
     
 	for (int i = 12; i < 1174; i++)
 	{
-		tmp = (((userData) ? *userData++ : 0) ^ scramling[i]) << 8;
-		
-		if (tmp & 0x100)
-		{
-			tmp |= 0xFF;
-		}
-		
-		buffer[i] = tmp;
+		buffer[i] = ((userData) ? *userData++ : 0) ^ scramling[i];
 	}
 
     // EDC/ECC - 4 bytes
-    tmp = scramling[1174] << 8;
-    if (tmp & 0x100)
-    {
-		tmp |= 0xFF;
-	}
-    buffer[1174] = tmp;
-    
-    tmp = scramling[1175] << 8;
-    if (tmp & 0x100)
-    {
-		tmp |= 0xFF;
-	}
-	buffer[1175] = tmp;
+    buffer[1174] = scramling[1174];
+	buffer[1175] = scramling[1175];
 }
 
 picostation::SubQ::Data __time_critical_func(picostation::DiscImage::generateSubQ)(const int sector)
@@ -414,6 +401,10 @@ FRESULT __time_critical_func(picostation::DiscImage::load)(const TCHAR *targetCu
     struct CueFile cue;
     struct CueParser parser;
     
+    // Already empty after unload, a disc loaded without one drops whatever the last one left open
+    m_extents.clear();
+    posix_file_reset();
+    
     if (!create_posix_file(&cue, targetCue, FA_READ))
     {
         DEBUG_PRINT("create_posix_file failed for: %s.\n", targetCue);
@@ -421,6 +412,8 @@ FRESULT __time_critical_func(picostation::DiscImage::load)(const TCHAR *targetCu
     
     cue.cfilename = targetCue;
     CueParser_construct(&parser, &m_cueDisc);
+    s_stage.tail = 0;
+    memset(s_parkSectors, 0, sizeof(s_parkSectors));
     CueParser_parse(&parser, &cue, &scheduler, fileopen, parser_cb);
     Scheduler_run(&scheduler);
     CueParser_close(&parser, &scheduler, close_cb);
@@ -448,11 +441,30 @@ FRESULT __time_critical_func(picostation::DiscImage::load)(const TCHAR *targetCu
     
     c_sectorMax = m_cueDisc.tracks[m_cueDisc.trackCount+1].indices[0] + 4652;
     
+    // Sectors are served through FatFs from here on, mapStep() moves them to direct reads
+    m_extents.begin(m_cueDisc);
+    
     return FR_OK;
 }
 
+bool picostation::DiscImage::mapStep()
+{
+    if (!m_extents.step(m_cueDisc))
+    {
+        return false;
+    }
+    
+    if (m_extents.done())
+    {
+        DEBUG_PRINT("Extents: %u\n", (unsigned) m_extents.size());
+    }
+    
+    return true;
+}
+
 void __time_critical_func(picostation::DiscImage::unload)()
 {
+    m_extents.clear();
 	DEBUG_PRINT("Close:\nTrack\tStart\tLength\tPregap\n");
 	if (m_cueDisc.trackCount == 1 || m_cueDisc.tracks[1].file->opaque == m_cueDisc.tracks[2].file->opaque)
 	{
@@ -472,6 +484,9 @@ void __time_critical_func(picostation::DiscImage::unload)()
 			}
 		}
 	}
+	
+	// The track files, their CueFiles and the tables all lived in the arena
+	posix_file_reset();
 }
 
 void __time_critical_func(picostation::DiscImage::makeDummyCue)()
@@ -480,6 +495,7 @@ void __time_critical_func(picostation::DiscImage::makeDummyCue)()
 
     constexpr uint32_t c_sectorCount = (98 * 75 * 60) + (57 * 75) + 74;  // 98:57:74(mm:ss:ff) leaving room for 2 sec pre-gap and lead-in
 
+    m_extents.clear();
     m_cueDisc.trackCount = 1;
 
     // Lead-in track
@@ -529,6 +545,37 @@ void __time_critical_func(picostation::DiscImage::readSector)(void *buffer, cons
     }
 }
 
+bool __time_critical_func(picostation::DiscImage::startReadSector)(void *buffer, const int sector, DataLocation location,
+                                                                   const uint16_t *scramling)
+{
+    if (location == DataLocation::SDCard)
+    {
+        return readSectorSD(buffer, sector, scramling, true);
+    }
+    
+    readSector(buffer, sector, location, scramling);
+    return false;
+}
+
+bool __time_critical_func(picostation::DiscImage::pollRead)()
+{
+    if (s_stage.busy)
+    {
+        disk_poll();
+        if (s_stage.busy)
+        {
+            return false;
+        }
+        
+        if (FR_OK != s_stage.res)
+        {
+            DEBUG_PRINT("f_read error: (%d)\n", s_stage.res);
+        }
+    }
+    
+    return true;
+}
+
 void __time_critical_func(picostation::DiscImage::readSectorRAM)(void *buffer, const int sector, const uint16_t *scramling)
 {
     const int adjustedSector = sector - c_preGap;
@@ -539,14 +586,15 @@ void __time_critical_func(picostation::DiscImage::readSectorRAM)(void *buffer, c
         if (targetOffset <= loaderImageSize - c_cdSamplesBytes)
         {
             const uint8_t *sectorData = getLoaderSectorData(adjustedSector);
-            scramble_data((uint32_t *) buffer, (uint16_t *) sectorData, scramling, 1176);
+            scramble_data((uint16_t *) buffer, (uint16_t *) sectorData, scramling, 1176);
             return;
         }
     }
-        buildSector(sector, static_cast<uint32_t *>(buffer), (uint16_t *) s_userData, scramling);
+        buildSector(sector, static_cast<uint16_t *>(buffer), (uint16_t *) s_userData, scramling);
 }
 
-void __time_critical_func(picostation::DiscImage::readSectorSD)(void *buffer, const int sector, const uint16_t *scramling)
+bool __time_critical_func(picostation::DiscImage::readSectorSD)(void *buffer, const int sector, const uint16_t *scramling,
+                                                                const bool async)
 {
     FRESULT fr;
     UINT br = 0;
@@ -556,10 +604,33 @@ void __time_critical_func(picostation::DiscImage::readSectorSD)(void *buffer, co
     if (adjustedSector >= 0 &&adjustedSector < 16 && m_cueDisc.tracks[1].trackType == CueTrackType::TRACK_TYPE_DATA)
 	{
         const uint8_t *sectorData = getLoaderSectorData(adjustedSector);
-		scramble_data((uint32_t *) buffer, (uint16_t *) sectorData, scramling, 1176);
-		return;
+		scramble_data((uint16_t *) buffer, (uint16_t *) sectorData, scramling, 1176);
+		return false;
 	}
     
+    // Resolved to the card at load, no file object or FAT involved
+    const ExtentMap::Extent *extent = m_extents.find(adjustedSector);
+    if (extent)
+    {
+        const FSIZE_t offset = extent->ofs + static_cast<FSIZE_t>(adjustedSector - extent->sector) * c_cdSamplesBytes;
+        const LBA_t lba = extent->lba + offset / FF_MAX_SS;
+        const UINT ofs = offset % FF_MAX_SS;
+        if (async)
+        {
+            fr = f_read_lba_async(&s_stage, lba, ofs, buffer, c_cdSamplesBytes, scramling, extent->data);
+        }
+        else
+        {
+            fr = f_read_lba(&s_stage, lba, ofs, buffer, c_cdSamplesBytes, scramling, extent->data);
+        }
+        if (FR_OK != fr)
+        {
+            DEBUG_PRINT("f_read_lba error: (%d)\n", fr);
+        }
+        
+        return async && s_stage.busy;
+    }
+    
     for (i = 1; i <= m_cueDisc.trackCount; i++)
     {
         if (adjustedSector < m_cueDisc.tracks[i + 1].indices[0])
@@ -577,15 +648,25 @@ void __time_critical_func(picostation::DiscImage::readSectorSD)(void *buffer, co
                     }
                 }
 
-                fr = f_read_scramble((FIL *)m_cueDisc.tracks[i].file->opaque, buffer, c_cdSamplesBytes, &br, 
-									 scramling, m_cueDisc.tracks[i].trackType == CueTrackType::TRACK_TYPE_DATA);
+                // CDDA goes out exactly as stored, data tracks are scrambled on the way out of the stage
+                const BYTE dataTrack = m_cueDisc.tracks[i].trackType == CueTrackType::TRACK_TYPE_DATA;
+                if (async)
+                {
+                    fr = f_read_staged_async((FIL *)m_cueDisc.tracks[i].file->opaque, &s_stage, buffer, c_cdSamplesBytes,
+                                             &br, scramling, dataTrack);
+                }
+                else
+                {
+                    fr = f_read_staged((FIL *)m_cueDisc.tracks[i].file->opaque, &s_stage, buffer, c_cdSamplesBytes, &br,
+                                       scramling, dataTrack);
+                }
                 //static uint16_t tmpbuf[1176];
                 //fr = f_read((FIL *)m_cueDisc.tracks[i].file->opaque, tmpbuf, 2352, &br);
                 if (FR_OK != fr)
                 {
                     DEBUG_PRINT("f_read error: (%d)\n",  fr);
                 }
-                //scramble_data((uint32_t *) buffer, tmpbuf, isCurrentTrackData() ? scramling : NULL, 1176);
+                //scramble_data((uint16_t *) buffer, tmpbuf, isCurrentTrackData() ? scramling : NULL, 1176);
                 break;
             }
         }
@@ -595,7 +676,7 @@ void __time_critical_func(picostation::DiscImage::readSectorSD)(void *buffer, co
 	{
 		DEBUG_PRINT("out of range image sec (%d)\n", adjustedSector);
 		memset(s_userData, 0, c_cdSamplesBytes);
-		buildSector(sector, static_cast<uint32_t *>(buffer), (uint16_t *) s_userData, scramling);
+		buildSector(sector, static_cast<uint16_t *>(buffer), (uint16_t *) s_userData, scramling);
 	}
     else if (br < c_cdSamplesBytes)
     {
@@ -603,6 +684,8 @@ void __time_critical_func(picostation::DiscImage::readSectorSD)(void *buffer, co
         //buildSector(sector, static_cast<uint8_t *>(buffer), s_userData);
         //br = c_cdSamplesBytes;
     }
+    
+    return async && s_stage.busy;
 }
 
 void picostation::DiscImage::setUniromPatchMode(UniromPatchMode mode)
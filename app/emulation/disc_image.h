@@ -7,6 +7,7 @@
 #include "../third_party/cueparser/disc.h"
 #include "../third_party/cueparser/scheduler.h"
 #include "../third_party/posix_file.h"
+#include "extent_map.h"
 #include "ff.h"
 #include "subq.h"
 
@@ -28,21 +29,29 @@ class DiscImage {
         PalToNtsc,
     };
 
-    void buildSector(const int sector, uint32_t *buffer, uint16_t *userData, const uint16_t *scramling);
+    void buildSector(const int sector, uint16_t *buffer, uint16_t *userData, const uint16_t *scramling);
+    // Core1 only, between reads: a read in flight or a map step would use what these give back
     FRESULT load(const TCHAR *targetCue);
     void unload();
+    // Walks the loaded image's cluster chains a little further, false once there is nothing left
+    bool mapStep();
     SubQ::Data generateSubQ(const int sector);
     bool hasData() { return m_hasData; };
+    const CueDisc &getCueDisc() const { return m_cueDisc; }
     void makeDummyCue();
     void readSector(void *buffer, const int sector, DataLocation location, const uint16_t *scramling);
+    // Returns true while the SD card is still filling the buffer, finish with pollRead(). One read at a time.
+    bool startReadSector(void *buffer, const int sector, DataLocation location, const uint16_t *scramling);
+    bool pollRead();
     void readSectorRAM(void *buffer, const int sector, const uint16_t *scramling);
-    void readSectorSD(void *buffer, const int sector, const uint16_t *scramling);
+    bool readSectorSD(void *buffer, const int sector, const uint16_t *scramling, const bool async = false);
     void setUniromPatchMode(UniromPatchMode mode);
     UniromPatchMode getUniromPatchMode() const;
 
   private:
     const uint8_t *getLoaderSectorData(int adjustedSector);
     CueDisc m_cueDisc;
+    ExtentMap m_extents;
     bool m_hasData = false;
     int m_currentLogicalTrack = 0;
     UniromPatchMode m_uniromPatchMode = UniromPatchMode::Default;
@@ -0,0 +1,276 @@
+// extent_map.cpp - Walks each track file's cluster chain in steps and builds the sector to LBA extent table.
+#include "extent_map.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "commons/values.h"
+#include "third_party/cueparser/fileabstract.h"
+#include "third_party/posix_file.h"
+
+namespace {
+// Links followed per step, a FAT32 or exFAT FAT sector worth, so a step costs one metadata read at most
+constexpr UINT c_stepClusters = 128;
+
+// Extents claimed from the arena at a time, up to half of its table room. Link map tables get the
+// rest first: without one a seek in a chained file walks the FAT, without an extent it only goes
+// through FatFs.
+constexpr size_t c_extentChunk = 32;
+constexpr size_t c_maxExtents = POSIX_FILE_TABLE_BYTES / 2 / sizeof(picostation::ExtentMap::Extent);
+
+FIL *trackFile(const CueDisc &disc, const int track)
+{
+    return disc.tracks[track].file ? static_cast<FIL *>(disc.tracks[track].file->opaque) : nullptr;
+}
+}  // namespace
+
+void picostation::ExtentMap::begin(const CueDisc &disc)
+{
+    clear();
+    startFile(disc, 1);
+}
+
+bool picostation::ExtentMap::step(const CueDisc &disc)
+{
+    if (m_track == 0)
+    {
+        return false;
+    }
+
+    FIL *fp = trackFile(disc, m_track);
+    if (FR_OK != f_fragment(fp, &m_walk, c_stepClusters))
+    {
+        // Broken chain, whatever is not mapped yet stays with FatFs
+        m_linkMap = nullptr;
+        m_walk.clst = 0;
+    }
+    else if (m_walk.len)
+    {
+        // Pieces of one fragment follow each other on the card, so sectors across their seam map too
+        if (m_runLen && m_walk.ofs == m_runOfs + m_runLen && m_walk.sect == m_runSect + m_runLen / FF_MAX_SS)
+        {
+            m_runLen += m_walk.len;
+        }
+        else
+        {
+            m_runSect = m_walk.sect;
+            m_runOfs = m_walk.ofs;
+            m_runLen = m_walk.len;
+        }
+        mapRun(disc);
+        addLink(m_walk.ncl, m_walk.scl);
+    }
+
+    if (m_walk.clst == 0)
+    {
+        finishFile(disc);
+    }
+
+    return true;
+}
+
+// The space itself goes back with the arena when the disc is unloaded
+void picostation::ExtentMap::clear()
+{
+    m_extents = nullptr;
+    m_count = 0;
+    m_capacity = 0;
+    m_linkMap = nullptr;
+    m_track = 0;
+}
+
+// Tracks sharing a file follow each other, the walk covers the file once for all of them
+void picostation::ExtentMap::startFile(const CueDisc &disc, int track)
+{
+    while (track <= disc.trackCount && !trackFile(disc, track))
+    {
+        track++;
+    }
+
+    m_track = track <= disc.trackCount ? track : 0;
+    m_walk = {};
+    m_linkMap = nullptr;
+    m_linkMapSize = 0;
+    m_linkMapCapacity = 0;
+    m_runLen = 0;
+    m_nextSector = 0;
+    if (m_track == 0)
+    {
+        return;
+    }
+
+    // NoFatChain files need no table, and one built for an earlier group of tracks is kept
+    FIL *fp = trackFile(disc, m_track);
+#if FF_FS_EXFAT
+    if (fp->obj.stat == 2)
+    {
+        return;
+    }
+#endif
+    if (!fp->cltbl)
+    {
+        m_linkMapCapacity = 16;
+        m_linkMap = static_cast<DWORD *>(posix_file_alloc(m_linkMapCapacity * sizeof(DWORD)));
+        m_linkMapSize = 1;  // Table size goes in front once it is known
+    }
+}
+
+void picostation::ExtentMap::finishFile(const CueDisc &disc)
+{
+    FIL *fp = trackFile(disc, m_track);
+
+    addLink(0, 0);
+    if (m_linkMap)
+    {
+        // Same layout CREATE_LINKMAP leaves behind: size, then cluster count and first cluster per
+        // fragment, then a zero
+        m_linkMap[0] = m_linkMapSize;
+        fp->cltbl = m_linkMap;
+        m_linkMap = nullptr;
+    }
+
+    int track = m_track;
+    while (track <= disc.trackCount && trackFile(disc, track) == fp)
+    {
+        track++;
+    }
+    startFile(disc, track);
+}
+
+// Same track boundaries as DiscImage::readSectorSD: track i serves everything below the start of
+// track i + 1, from the point its file begins. Sectors split across two fragments are left out.
+void picostation::ExtentMap::mapRun(const CueDisc &disc)
+{
+    const int runFirst = static_cast<int>((m_runOfs + c_cdSamplesBytes - 1) / c_cdSamplesBytes);
+    const int runEnd = static_cast<int>((m_runOfs + m_runLen) / c_cdSamplesBytes);
+    const int fileFirst = std::max(runFirst, m_nextSector);
+    if (fileFirst >= runEnd)
+    {
+        return;
+    }
+    m_nextSector = runEnd;
+
+    FIL *fp = trackFile(disc, m_track);
+    for (int track = m_track; track <= disc.trackCount && trackFile(disc, track) == fp; track++)
+    {
+        const CueTrack &cueTrack = disc.tracks[track];
+        const int fileOffset = static_cast<int>(cueTrack.fileOffset);
+        const int trackStart = track == 1 ? fileOffset : std::max(static_cast<int>(cueTrack.indices[0]), fileOffset);
+        const int first = std::max(trackStart, fileOffset + fileFirst);
+        const int end = std::min(static_cast<int>(disc.tracks[track + 1].indices[0]), fileOffset + runEnd);
+        if (first >= end)
+        {
+            continue;
+        }
+
+        const FSIZE_t into = static_cast<FSIZE_t>(first - fileOffset) * c_cdSamplesBytes - m_runOfs;
+        append({first, static_cast<uint32_t>(end - first), m_runSect + static_cast<LBA_t>(into / FF_MAX_SS),
+                static_cast<uint16_t>(into % FF_MAX_SS), cueTrack.trackType == CueTrackType::TRACK_TYPE_DATA});
+    }
+}
+
+// Fragments come in disc order, so appending keeps the table sorted
+void picostation::ExtentMap::append(const Extent &extent)
+{
+    if (m_count)
+    {
+        // A run growing a piece at a time carries on the last extent
+        Extent &last = at(m_count - 1);
+        if (last.sector + static_cast<int>(last.count) == extent.sector && last.data == extent.data &&
+            static_cast<uint64_t>(last.lba) * FF_MAX_SS + last.ofs + static_cast<uint64_t>(last.count) * c_cdSamplesBytes ==
+                static_cast<uint64_t>(extent.lba) * FF_MAX_SS + extent.ofs)
+        {
+            last.count += extent.count;
+            return;
+        }
+    }
+
+    if (m_count == m_capacity)
+    {
+        if (m_capacity + c_extentChunk > c_maxExtents)
+        {
+            return;
+        }
+
+        Extent *chunk = static_cast<Extent *>(posix_file_alloc_top(c_extentChunk * sizeof(Extent)));
+        if (!chunk)
+        {
+            return;
+        }
+        if (!m_extents)
+        {
+            m_extents = chunk + c_extentChunk;
+        }
+        m_capacity += c_extentChunk;
+    }
+
+    at(m_count++) = extent;
+}
+
+void picostation::ExtentMap::addLink(const DWORD clusters, const DWORD first)
+{
+    if (!m_linkMap)
+    {
+        return;
+    }
+
+    // Steps hand a fragment over in pieces, a piece carrying on from the last one extends its pair
+    if (clusters && m_linkMapSize >= 3 && m_linkMap[m_linkMapSize - 1] + m_linkMap[m_linkMapSize - 2] == first)
+    {
+        m_linkMap[m_linkMapSize - 2] += clusters;
+        return;
+    }
+
+    const size_t needed = m_linkMapSize + (clusters ? 2 : 1);
+    if (needed > m_linkMapCapacity)
+    {
+        // Still the arena's last allocation, the walk finishes one file before starting the next.
+        // Short of room for twice the size, it takes only what this entry needs.
+        size_t capacity = m_linkMapCapacity * 2;
+        if (!posix_file_grow(m_linkMap, capacity * sizeof(DWORD)))
+        {
+            capacity = needed;
+            if (!posix_file_grow(m_linkMap, capacity * sizeof(DWORD)))
+            {
+                m_linkMap = nullptr;
+                return;
+            }
+        }
+        m_linkMapCapacity = capacity;
+    }
+
+    m_linkMap[m_linkMapSize++] = clusters;
+    if (clusters)
+    {
+        m_linkMap[m_linkMapSize++] = first;
+    }
+}
+
+const picostation::ExtentMap::Extent *__time_critical_func(picostation::ExtentMap::find)(const int sector) const
+{
+    // Extents are in sector order, find the last one starting at or before the sector
+    size_t low = 0;
+    size_t high = m_count;
+    while (low < high)
+    {
+        const size_t mid = (low + high) / 2;
+        if (at(mid).sector <= sector)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    if (low == 0)
+    {
+        return nullptr;
+    }
+
+    const Extent *extent = &at(low - 1);
+    return static_cast<uint32_t>(sector - extent->sector) < extent->count ? extent : nullptr;
+}
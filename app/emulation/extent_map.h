@@ -0,0 +1,64 @@
+// extent_map.h - Disc sectors resolved to card LBAs in the background after load, so streaming skips FatFs.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../third_party/cueparser/disc.h"
+#include "ff.h"
+
+namespace picostation {
+class ExtentMap {
+  public:
+    // Run of disc sectors lying back to back on the card. Sector n of the run starts at byte
+    // ofs + n * 2352 counted from the first byte of block lba.
+    struct Extent
+    {
+        int sector;             // First sector, as readSectorSD counts them
+        uint32_t count;
+        LBA_t lba;
+        uint16_t ofs;
+        bool data;              // Data track, descrambled on the way out
+    };
+
+    ExtentMap() {};
+    ~ExtentMap() { clear(); }
+
+    // Nothing is resolved by begin(), each step() follows a few links of the track files' cluster
+    // chains in disc order. Sectors turn into direct reads as their clusters are found, the rest
+    // keep going through FatFs. A chained file gets its link map table once its walk is done.
+    void begin(const CueDisc &disc);
+    bool step(const CueDisc &disc);  // False once there is nothing left to walk
+    bool done() const { return m_track == 0; }
+    void clear();
+    const Extent *find(const int sector) const;
+    size_t size() const { return m_count; }
+
+  private:
+    void startFile(const CueDisc &disc, int track);
+    void finishFile(const CueDisc &disc);
+    void mapRun(const CueDisc &disc);
+    void append(const Extent &extent);
+    void addLink(DWORD clusters, DWORD first);
+
+    // The table grows down from the top of the posix_file arena, entry i sits i + 1 places below m_extents
+    Extent &at(const size_t i) const { return m_extents[-1 - static_cast<ptrdiff_t>(i)]; }
+
+    Extent *m_extents = nullptr;
+    size_t m_count = 0;
+    size_t m_capacity = 0;
+
+    // Walk in progress: first track of the file on it, the chain position and its link map table so far
+    int m_track = 0;
+    FFRAG m_walk = {};
+    DWORD *m_linkMap = nullptr;
+    size_t m_linkMapSize = 0;
+    size_t m_linkMapCapacity = 0;
+
+    // Stretch of the card the pieces handed out so far make up, and the file's first sector not mapped yet
+    LBA_t m_runSect = 0;
+    FSIZE_t m_runOfs = 0;
+    FSIZE_t m_runLen = 0;
+    int m_nextSector = 0;
+};
+}  // namespace picostation
@@ -3,8 +3,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <malloc.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <array>
@@ -14,8 +16,12 @@
 #include "emulation/disc_image.h"
 #include "emulation/drive_mechanics.h"
 #include "ff.h"
+#include "sd_spi.h"
 #include "commons/global.h"
+#include "hardware/irq.h"
 #include "hardware/pio.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
 #include "commons/logging.h"
 #include "main.pio.h"
 #include "emulation/modchip.h"
@@ -39,9 +45,23 @@ pseudoatomic<int> g_entryOffset;
 picostation::DiscImage::DataLocation s_dataLocation = picostation::DiscImage::DataLocation::RAM;
 static FATFS s_fatFS;
 
+// Read addresses fed to the data channel by the control channel, a 0 entry stops the chain
+static volatile uint32_t s_dmaRing[DMA_RING_SIZE] __attribute__((aligned(DMA_RING_SIZE * sizeof(uint32_t))));
+
+static uint16_t (*pioSamples)[1176] = nullptr;
+
+extern char __StackLimit;  // Top of the heap, from the linker script
+
+extern picostation::I2S m_i2s;
+
+static void __time_critical_func(i2s_dma_irq_hnd)()
+{
+	m_i2s.dmaIRQHandler();
+}
+
 static uint16_t *generateScramblingLUT()
 {
-    static uint16_t ScramblingLUT[1176] = {0};
+    static uint16_t ScramblingLUT[1176] __attribute__((aligned(4))) = {0};
     int shift = 1;
 	
 	for (int i = 0; i < 6; i++)
@@ -72,6 +92,78 @@ static uint16_t *generateScramblingLUT()
     return ScramblingLUT;
 }
 
+#if DEBUG_I2S
+// The sample-at-a-time loop scramble_data used before the word kernel, kept for comparison
+static void __time_critical_func(scrambleSamples)(uint16_t *dst, const uint16_t *src, const uint16_t *scramling, uint32_t len)
+{
+    while (len--)
+    {
+        if (scramling)
+        {
+            *dst++ = *src++ ^ *scramling++;
+        }
+        else
+        {
+            *dst++ = *src++;
+        }
+    }
+}
+
+static void benchmarkDescramble(const uint16_t *lut)
+{
+    static uint16_t src[1176];
+    static uint16_t dst[1176];
+    
+    // SysTick on the processor clock, counting down
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+    
+    auto cycles = [](auto &&kernel) -> unsigned long
+    {
+        const uint32_t start = systick_hw->cvr;
+        kernel();
+        return (start - systick_hw->cvr) & 0x00FFFFFF;
+    };
+    
+    const unsigned long oldData = cycles([&] { scrambleSamples(dst, src, lut, 1176); });
+    const unsigned long newData = cycles([&] { scramble_data(dst, src, lut, 1176); });
+    const unsigned long oldCDDA = cycles([&] { scrambleSamples(dst, src, nullptr, 1176); });
+    const unsigned long newCDDA = cycles([&] { scramble_cdda(dst, src, 1176); });
+    
+    DEBUG_PRINT("descramble cycles/sector: data %lu -> %lu, cdda %lu -> %lu\n", oldData, newData, oldCDDA, newCDDA);
+}
+#endif
+
+// Size the sector cache from the SRAM left over on this chip
+void picostation::I2S::allocateSectorBuffers()
+{
+    const struct mallinfo heap = mallinfo();
+    const size_t freeHeap = (size_t) (&__StackLimit - (char *) sbrk(0)) + heap.fordblks;
+    const size_t usable = freeHeap > CACHE_HEAP_RESERVE ? freeHeap - CACHE_HEAP_RESERVE : 0;
+    
+    m_cachedSectors = std::min<int>(usable / sizeof(*pioSamples), CACHED_SECS_MAX);
+    
+    while (m_cachedSectors >= CACHED_SECS_MIN)
+    {
+        pioSamples = (uint16_t (*)[1176]) malloc(m_cachedSectors * sizeof(*pioSamples));
+        if (pioSamples)
+        {
+            break;
+        }
+        m_cachedSectors--;
+    }
+    
+    if (!pioSamples)
+    {
+        panic("Sector cache: only %u bytes of heap free\n", (unsigned) freeHeap);
+    }
+    
+    DEBUG_PRINT("Sector cache: %d sectors (%u KB), %u KB heap left\n", m_cachedSectors,
+                (unsigned) (m_cachedSectors * sizeof(*pioSamples) / 1024),
+                (unsigned) ((freeHeap - m_cachedSectors * sizeof(*pioSamples)) / 1024));
+}
+
 void picostation::I2S::mountSDCard()
 {
     FRESULT fr = f_mount(&s_fatFS, "", 1);
@@ -79,30 +171,393 @@ void picostation::I2S::mountSDCard()
     {
         panic("f_mount error: (%d)\n", fr);
     }
+    
+    const sd_card_info_t *card = sd_get_card_info();
+    DEBUG_PRINT("SD card: %lu kHz%s\n", (unsigned long) (card->baud / 1000), card->high_speed ? ", high speed" : "");
+    
+#if SD_PROFILE_AT_MOUNT
+    // Spread over the data area of the volume, where the images are
+    if (!sd_profile_card(s_fatFS.database, (s_fatFS.n_fatent - 2) * s_fatFS.csize))
+    {
+        const sd_card_profile_t *profile = sd_get_card_profile();
+        DEBUG_PRINT("SD profile: %lu KB/s, 4K random %lu us (max %lu), CMD17 %lu us, CMD18 %lu us\n",
+                    (unsigned long) profile->seq_kbps, (unsigned long) profile->rand_us,
+                    (unsigned long) profile->rand_max_us, (unsigned long) profile->cmd17_us,
+                    (unsigned long) profile->cmd18_us);
+    }
+#endif
+}
+
+// Card profile as the menu reads it from the listing sector, big-endian:
+// u8 version, u8 flags, u32 SPI clock Hz, u32 sequential KB/s, u32 random 4K avg us, u32 random 4K max us,
+// u32 CMD17 us, u32 CMD18 us. Flags: bit 0 high speed mode, bit 1 profiled, bit 2 too slow for 2x.
+size_t picostation::I2S::buildCardProfile(uint8_t *data)
+{
+    const sd_card_info_t *card = sd_get_card_info();
+    const sd_card_profile_t *profile = sd_get_card_profile();
+    
+    // Too slow when it can't stream 2x with margin, or one random read outlasts the whole prefetch window
+    const bool profiled = profile->seq_kbps != 0;
+    const uint32_t windowUs = (m_cachedSectors - 2) * 1000000u / 150;
+    const bool slow = profiled && (profile->seq_kbps < SD_SLOW_KBPS || profile->rand_max_us > windowUs);
+    
+    const uint32_t values[] = {card->baud, profile->seq_kbps, profile->rand_us, profile->rand_max_us,
+                               profile->cmd17_us, profile->cmd18_us};
+    
+    size_t size = 0;
+    data[size++] = 1;
+    data[size++] = (card->high_speed ? 1 : 0) | (profiled ? 2 : 0) | (slow ? 4 : 0);
+    for (const uint32_t value : values)
+    {
+        data[size++] = value >> 24;
+        data[size++] = value >> 16;
+        data[size++] = value >> 8;
+        data[size++] = value;
+    }
+    
+    return size;
+}
+
+// Core1 only, the cache and the queue are not safe to touch from the other core. No read may be in flight.
+void __time_critical_func(picostation::I2S::reinitI2S)()
+{
+    // Sectors the IRQ has not taken yet belong to the old state, they go with the pins they hold.
+    // With IRQs off this core stands in for the consumer.
+    const uint32_t irqState = save_and_disable_interrupts();
+    while (const QueuedSector *entry = m_sectorQueue.front())
+    {
+        m_sectorCache.unpin(entry->buffer);
+        m_sectorQueue.pop();
+    }
+    m_queuedSector = -1;
+    restore_interrupts(irqState);
+    
+    m_sectorCache.invalidate();
+    lastSector = -1;
+    m_prefetchSector = -1;
+    i2s_state = 0;
+}
+
+// Core1 picks the request up at the top of its next pass
+void picostation::I2S::requestReinit()
+{
+    m_reinitPending = true;
+    while (m_reinitPending.Load())
+    {
+        tight_loop_contents();
+    }
+}
+
+// Core1 may be reading from the image or mapping it, so it unloads it between two sectors
+void picostation::I2S::requestUnload()
+{
+    m_unloadPending = true;
+    while (m_unloadPending.Load())
+    {
+        tight_loop_contents();
+    }
 }
 
-int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int transfer_count)
+void picostation::I2S::initDMA(const volatile void *read_addr, unsigned int transfer_count)
 {
-    int channel = dma_claim_unused_channel(true);
-    dma_channel_config c = dma_channel_get_default_config(channel);
+    dmaChannel = dma_claim_unused_channel(true);
+    dmaCtrlChannel = dma_claim_unused_channel(true);
+    
+    // Data channel: one sector buffer into the PIO, then hands over to the control channel
+    dma_channel_config c = dma_channel_get_default_config(dmaChannel);
     channel_config_set_read_increment(&c, true);
     channel_config_set_write_increment(&c, false);
-    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
     const unsigned int i2sDREQ = PIOInstance::I2S_DATA == pio0 ? DREQ_PIO0_TX0 : DREQ_PIO1_TX0;
     channel_config_set_dreq(&c, i2sDREQ);
-    dma_channel_configure(channel, &c, &PIOInstance::I2S_DATA->txf[SM::I2S_DATA], read_addr, transfer_count, false);
+    channel_config_set_chain_to(&c, dmaCtrlChannel);
+    dma_channel_configure(dmaChannel, &c, &PIOInstance::I2S_DATA->txf[SM::I2S_DATA], read_addr, transfer_count, false);
+    
+    // Control channel: loads the next ring entry into the data channel and retriggers it
+    c = dma_channel_get_default_config(dmaCtrlChannel);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_ring(&c, false, __builtin_ctz(sizeof(s_dmaRing)));
+    
+    for (int i = 0; i < DMA_RING_SIZE; i++)
+    {
+        s_dmaRing[i] = 0;
+        m_ringSector[i] = -1;
+        m_ringBuffer[i] = -1;
+    }
+    m_ringTail = 0;
+    m_ringPlaying = DMA_RING_SIZE;
+    m_queuedSector = -1;
+    m_sentSubQ[0].sector = -1;
+    m_sentSubQ[1].sector = -1;
+    m_sentSubQIndex = 0;
+    
+    // Start out as if the chain had just stopped on the terminator at the tail
+    dma_channel_configure(dmaCtrlChannel, &c, &dma_hw->ch[dmaChannel].al3_read_addr_trig, &s_dmaRing[1], 1, false);
+    
+    // Every finished sector hands over to the IRQ, which runs on this core
+    dma_channel_set_irq0_enabled(dmaChannel, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, i2s_dma_irq_hnd);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+// Ring index the control channel will load next
+uint32_t __time_critical_func(picostation::I2S::ringFetchIndex)()
+{
+    return ((dma_hw->ch[dmaCtrlChannel].read_addr - (uint32_t) s_dmaRing) / sizeof(uint32_t)) & (DMA_RING_SIZE-1);
+}
+
+bool __time_critical_func(picostation::I2S::isDMAIdle)()
+{
+    // A stopped chain has always just loaded the terminator at the tail.
+    // The control channel writes the data trigger before it goes idle, so check it first.
+    return ringFetchIndex() == ((m_ringTail + 1) & (DMA_RING_SIZE-1)) &&
+           !dma_channel_is_busy(dmaCtrlChannel) && !dma_channel_is_busy(dmaChannel);
+}
 
-    return channel;
+// True while an entry waits in the ring behind the one being sent
+bool __time_critical_func(picostation::I2S::isRingQueued)()
+{
+    return !isDMAIdle() && ringFetchIndex() != m_ringTail;
+}
+
+bool __time_critical_func(picostation::I2S::hasQueuedSector)()
+{
+    return !m_sectorQueue.empty() || isRingQueued();
+}
+
+// Producer side: claim a queue slot for a sector whose buffer may still be loading.
+// The SubQ is worked out here so neither the IRQ nor core0's alarm has to.
+picostation::I2S::QueuedSector *__time_critical_func(picostation::I2S::beginQueueSector)(const int sector, const int buffer)
+{
+    QueuedSector *entry = m_sectorQueue.back();
+    
+    if (!entry)
+    {
+        return nullptr;
+    }
+    
+    m_sectorCache.pin(buffer);
+    entry->sector = sector;
+    entry->buffer = buffer;
+    entry->subq = g_discImage.generateSubQ(sector);
+    entry->ready = false;
+    m_sectorQueue.push();
+    m_queuedSector = sector;
+    
+    return entry;
+}
+
+// Mark the buffer filled and have the IRQ look at the ring straight away
+void __time_critical_func(picostation::I2S::finishQueueSector)(QueuedSector *entry)
+{
+    __dmb();
+    entry->ready = true;
+    hw_set_bits(&dma_hw->intf0, 1u << dmaChannel);
+}
+
+void __time_critical_func(picostation::I2S::queueSector)(const int sector, const int buffer)
+{
+    QueuedSector *entry = beginQueueSector(sector, buffer);
+    
+    if (entry)
+    {
+        finishQueueSector(entry);
+    }
+}
+
+bool __time_critical_func(picostation::I2S::getSentSubQ)(const int sector, SubQ::Data &data)
+{
+    const SentSubQ &sent = m_sentSubQ[m_sentSubQIndex.Load()];
+    
+    if (sent.sector != sector)
+    {
+        return false;
+    }
+    
+    data = sent.data;
+    return true;
+}
+
+// Append a ready sector behind the one being sent, restarting the chain if it has run dry
+void __time_critical_func(picostation::I2S::appendToRing)(const QueuedSector &entry)
+{
+    const uint32_t slot = m_ringTail;
+    const uint32_t next = (slot + 1) & (DMA_RING_SIZE-1);
+    const bool restart = isDMAIdle();
+    
+    m_ringSector[slot] = entry.sector;
+    m_ringBuffer[slot] = entry.buffer;
+    m_ringSubQ[slot] = entry.subq;
+    m_ringSector[next] = -1;
+    m_ringBuffer[next] = -1;
+    
+    // Terminate first, the control channel may pick up the new entry as soon as it is written
+    s_dmaRing[next] = 0;
+    __dmb();
+    s_dmaRing[slot] = (uint32_t) pioSamples[entry.buffer];
+    __dmb();
+    m_ringTail = next;
+    
+    if (restart)
+    {
+        // The PIO waits for LRCK by itself
+        dma_channel_set_read_addr(dmaCtrlChannel, &s_dmaRing[slot], true);
+    }
+}
+
+// Publish the sector the DMA moved on to and release the buffer it finished with
+void __time_critical_func(picostation::I2S::publishStartedSector)()
+{
+    const uint32_t fetched = (ringFetchIndex() - 1) & (DMA_RING_SIZE-1);
+    
+    if (fetched == m_ringPlaying || m_ringSector[fetched] < 0)
+    {
+        return;
+    }
+    
+    const int subqIndex = m_sentSubQIndex.Load() ^ 1;
+    m_sentSubQ[subqIndex].sector = m_ringSector[fetched];
+    m_sentSubQ[subqIndex].data = m_ringSubQ[fetched];
+    __dmb();
+    m_sentSubQIndex = subqIndex;
+    
+    m_sectorSending = m_ringSector[fetched];
+    m_lastSectorTime = time_us_64();
+    
+    if (m_ringPlaying < DMA_RING_SIZE && m_ringBuffer[m_ringPlaying] >= 0)
+    {
+        m_sectorCache.unpin(m_ringBuffer[m_ringPlaying]);
+    }
+    m_ringPlaying = fetched;
+}
+
+void __time_critical_func(picostation::I2S::dmaIRQHandler)()
+{
+    const uint32_t mask = 1u << dmaChannel;
+    
+    dma_hw->ints0 = mask;
+    hw_clear_bits(&dma_hw->intf0, mask);
+    m_stats.dmaIRQs++;
+    
+    // On a completion the control channel has already loaded the next entry
+    publishStartedSector();
+    
+    const QueuedSector *entry = m_sectorQueue.front();
+    
+    if (entry && entry->ready && !isRingQueued())
+    {
+        const bool underrun = isDMAIdle() && m_ringPlaying < DMA_RING_SIZE;
+        
+        appendToRing(*entry);
+        m_sectorQueue.pop();
+        
+        if (underrun)
+        {
+            m_stats.underruns++;
+        }
+        
+        // Restarted from idle, the new entry is already going out
+        publishStartedSector();
+    }
+}
+
+#if DEBUG_I2S
+void picostation::I2S::reportStats()
+{
+    static uint64_t lastReport = 0;
+    static Stats last = {};
+    const uint64_t now = time_us_64();
+    
+    if (now - lastReport < 5000000)
+    {
+        return;
+    }
+    
+    const uint32_t windowUs = now - lastReport;
+    const uint32_t idleUs = m_stats.idleUs - last.idleUs;
+    
+    DEBUG_PRINT("i2s: idle %lu%% (%lu/%lu passes), %lu irqs, %lu underruns\n",
+                (unsigned long) ((uint64_t) idleUs * 100 / windowUs),
+                (unsigned long) (m_stats.idlePasses - last.idlePasses),
+                (unsigned long) (m_stats.loopPasses - last.loopPasses),
+                (unsigned long) (m_stats.dmaIRQs - last.dmaIRQs),
+                (unsigned long) (m_stats.underruns - last.underruns));
+    
+    // SD side: throughput while reading, and CPU time per CD sector with the DMA waits taken out
+    static sd_read_stats_t lastSD = {};
+    const sd_read_stats_t sd = *sd_get_read_stats();
+    const uint64_t sdBytes = sd.bytes - lastSD.bytes;
+    const uint64_t sdUs = sd.total_us - lastSD.total_us;
+    const uint64_t busyUs = sdUs - (sd.wait_us - lastSD.wait_us);
+    if (sdBytes && sdUs)
+    {
+        DEBUG_PRINT("sd: %lu KB/s, %lu us busy per sector, %lu streams, %lu crc errors (%lu failed), "
+                    "metadata %lu/%lu hits\n",
+                    (unsigned long) (sdBytes * 1000000 / 1024 / sdUs),
+                    (unsigned long) (busyUs * 2352 / sdBytes),
+                    (unsigned long) (sd.streams - lastSD.streams),
+                    (unsigned long) (sd.crc_errors - lastSD.crc_errors),
+                    (unsigned long) (sd.crc_failures - lastSD.crc_failures),
+                    (unsigned long) (sd.meta_hits - lastSD.meta_hits),
+                    (unsigned long) (sd.meta_hits + sd.meta_misses - lastSD.meta_hits - lastSD.meta_misses));
+    }
+    lastSD = sd;
+    
+    last = m_stats;
+    lastReport = now;
+}
+#endif
+
+int picostation::I2S::prefetchDepth()
+{
+    // Keep roughly the same amount of time buffered at both speeds
+    int depth = (g_targetPlaybackSpeed == 1) ? PREFETCH_DEPTH_1X : PREFETCH_DEPTH_2X;
+    
+    // Enough to play through the slowest random read seen at mount, so a stall on a slow card doesn't drain it
+    const int stallSectors = sd_get_card_profile()->rand_max_us * 75 * g_targetPlaybackSpeed / 1000000 + 2;
+    depth = std::max(depth, stallSectors);
+    
+    return std::min(depth, m_cachedSectors - 2);
+}
+
+// Fill the cache from a seek target onwards while the console is still waiting for focus and GFS.
+// Gives up as soon as core0 posts another target.
+void __time_critical_func(picostation::I2S::readAheadOfSeek)(const int sector, const uint16_t *scramling)
+{
+    const int last = std::min(sector + SEEK_READAHEAD, c_sectorMax-3);
+    
+    for (int s = std::max(sector, 4650); s <= last && m_seekHint.Load() == sector; s++)
+    {
+        if (m_sectorCache.find(s) >= 0)
+        {
+            continue;
+        }
+        
+        const int buffer = m_sectorCache.reserve(s);
+        if (buffer < 0)
+        {
+            break;
+        }
+        
+        g_discImage.readSector(pioSamples[buffer], s - c_leadIn, s_dataLocation, scramling);
+        m_sectorCache.commit(s, buffer);
+#if DEBUG_I2S0
+        DEBUG_PRINT("seek read %d\n", s);
+#endif
+    }
+    
+    m_prefetchSector = last + 1;
 }
 
 [[noreturn]] void __time_critical_func(picostation::I2S::start)(MechCommand &mechCommand)
 {
     picostation::ModChip modChip;
-    static uint32_t pioSamples[CACHED_SECS][1176];
     static uint16_t *cdScramblingLUT = generateScramblingLUT();
 
-    static uint8_t bufferForDMA = 1;
-    static uint8_t bufferForSDRead = 0;
+    static int bufferForDMA = -1;
+    static int sectorForDMA = -1;
     static int currentSector = -1;
     lastSector = -1;
     m_sectorSending = -1;
@@ -115,10 +570,89 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
     
     menu_active = true;
     s_doorPending = false;
+    m_seekHint = -1;
+    m_reinitPending = false;
+    m_unloadPending = false;
     
+    allocateSectorBuffers();
+    m_sectorCache.init(m_cachedSectors);
     reinitI2S();
 	
-    dmaChannel = initDMA(pioSamples[0], 1176);
+    initDMA(pioSamples[0], 1176);
+
+#if DEBUG_I2S
+    uint64_t startTime;
+    uint64_t endTime;
+#endif
+
+    // The buffer for the next sector stays pinned in the cache, as do the ones in the DMA ring
+    auto setBufferForDMA = [&](const int buffer, const int sector)
+    {
+        if (bufferForDMA >= 0)
+        {
+            m_sectorCache.unpin(bufferForDMA);
+        }
+        m_sectorCache.pin(buffer);
+        bufferForDMA = buffer;
+        sectorForDMA = sector;
+    };
+    
+    // SD reads run in the background, one at a time. The buffer stays pinned until the read is committed.
+    auto startRead = [&](const int sector, const int buffer, QueuedSector *queued, const bool demand)
+    {
+        m_sectorCache.pin(buffer);
+        m_pendingRead = {sector, buffer, queued, demand};
+#if DEBUG_I2S
+        startTime = time_us_64();
+#endif
+        
+        g_discImage.startReadSector(pioSamples[buffer], sector - c_leadIn, s_dataLocation, cdScramblingLUT);
+    };
+    
+    // Returns true once no read is in flight, committing the one that just finished
+    auto completeRead = [&](const bool wait) -> bool
+    {
+        if (m_pendingRead.buffer < 0)
+        {
+            return true;
+        }
+        
+        while (!g_discImage.pollRead())
+        {
+            if (!wait)
+            {
+                return false;
+            }
+        }
+        
+        const PendingRead done = m_pendingRead;
+        m_pendingRead.buffer = -1;
+#if DEBUG_I2S
+        endTime = time_us_64() - startTime;
+        
+        if (endTime > 5000)
+        {
+            DEBUG_PRINT("read time: %lluus (%d)\n", endTime, done.sector);
+        }
+#endif
+        
+        // Every reset waits for this first, so the read always belongs to the current disc and position
+        m_sectorCache.commit(done.sector, done.buffer);
+        
+        if (done.demand)
+        {
+            setBufferForDMA(done.buffer, done.sector);
+            lastSector = done.sector;
+        }
+        m_sectorCache.unpin(done.buffer);
+        
+        if (done.queued)
+        {
+            finishQueueSector(done.queued);
+        }
+        
+        return true;
+    };
 
     g_coreReady[1] = true;          // Core 1 is ready
     while (!g_coreReady[0].Load())  // Wait for Core 0 to be ready
@@ -129,10 +663,8 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
     modChip.init();
 
 #if DEBUG_I2S
-    uint64_t startTime;
-    uint64_t endTime;
+    benchmarkDescramble(cdScramblingLUT);
 #endif
-
 	mountSDCard();
 
     g_discImage.makeDummyCue();
@@ -144,10 +676,48 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
 
     while (true)
     {
+        const uint64_t passStart = time_us_64();
+        bool passBusy = false;
+        
         // Sector could change during the loop, so we need to keep track of it
         currentSector = g_driveMechanics.getSector();
         
+        completeRead(false);
+        
+        // Core0 asked for the menu back, the image goes once nothing is streaming from it.
+        // The menu takes over before the flag drops, no read of this pass may reach the closed files.
+        if (m_unloadPending.Load())
+        {
+            completeRead(true);
+            g_discImage.unload();
+            g_discImage.makeDummyCue();
+            s_dataLocation = picostation::DiscImage::DataLocation::RAM;
+            menu_active = true;
+            m_unloadPending = false;
+            continue;
+        }
+        
+        // Core0 reset the drive, start over once the read in flight is in
+        if (m_reinitPending.Load())
+        {
+            completeRead(true);
+            reinitI2S();
+            m_reinitPending = false;
+        }
+        
         modChip.sendLicenseString(currentSector, mechCommand);
+        
+        const int seekHint = m_seekHint.Load();
+        if (seekHint != m_seekHintSeen)
+        {
+            m_seekHintSeen = seekHint;
+            if (!menu_active && seekHint >= 0)
+            {
+                completeRead(true);
+                readAheadOfSeek(seekHint, cdScramblingLUT);
+                passBusy = true;
+            }
+        }
 		
 		if (menu_active && needFileCheckAction.Load() != picostation::FileListingStates::IDLE)
 		{
@@ -196,6 +766,7 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
 					loadedImageIndex = g_fileArg.Load();
 					picostation::DirectoryListing::getPath(loadedImageIndex, filePath);
 					//printf("image cue name:%s\n", filePath);
+					completeRead(true);
 					g_discImage.load(filePath);
 					needFileCheckAction = picostation::FileListingStates::IDLE;
 					img_count = DirectoryListing::getDirectoryEntriesCount();
@@ -206,11 +777,21 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
 					break;
 				}
 				
+				case picostation::FileListingStates::GET_CARD_PROFILE:
+				{
+					uint8_t profile[32];
+					picostation::DirectoryListing::setListingData(profile, buildCardProfile(profile));
+					listReadyState = 1;
+					needFileCheckAction = picostation::FileListingStates::PROCESS_FILES;
+					break;
+				}
+				
 				case picostation::FileListingStates::PROCESS_FILES:
 				{
 					if (!listReadyState.Load())
 					{
 						picostation::DirectoryListing::getDirectoryEntries(g_entryOffset.Load());
+						passBusy = true;
 						listReadyState = 1;
 					}
 					break;
@@ -230,6 +811,7 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
 			
 			char filePath[c_maxFilePathLength + 1];
 			picostation::DirectoryListing::getPath(loadedImageIndex, filePath);
+			completeRead(true);
 			g_discImage.unload();
 			g_discImage.load(filePath);
 			
@@ -240,86 +822,143 @@ int picostation::I2S::initDMA(const volatile void *read_addr, unsigned int trans
         // Data sent via DMA, load the next sector
         if (currentSector != lastSector && currentSector >= 4650 && currentSector < c_sectorMax-2)
         {
-			if (!menu_active)
+			const int cachedBuffer = menu_active ? -1 : m_sectorCache.find(currentSector);
+			
+			if (cachedBuffer >= 0)
 			{
-				for (int i = 0; i < CACHED_SECS; i++)
-				{
-					if (loadedSector[i] == currentSector)
-					{
-						// already in cache
-						bufferForDMA = i;
-						lastSector = currentSector;
+				// already in cache
+				setBufferForDMA(cachedBuffer, currentSector);
+				lastSector = currentSector;
 #if DEBUG_I2S0
-						DEBUG_PRINT("sector %d in cache\n", currentSector);
+				DEBUG_PRINT("sector %d in cache\n", currentSector);
 #endif
-						goto continue_transfer;
-					}
-				}
+				goto continue_transfer;
 			}
 			
-			while (bufferForSDRead == bufferForDMA)
+			// The bus is busy, come back once the read in flight is done
+			if (m_pendingRead.buffer >= 0)
 			{
-				++bufferForSDRead &= (CACHED_SECS-1);
+				goto continue_transfer;
+			}
+			
+			const int bufferForSDRead = m_sectorCache.reserve(currentSector);
+			
+			if (bufferForSDRead < 0)
+			{
+				goto continue_transfer;
+			}
+			
+			// Queue the sector before reading it, the IRQ picks it up once it is marked ready
+			QueuedSector *queued = nullptr;
+			if (i2s_state)
+			{
+				const uint32_t irqState = save_and_disable_interrupts();
+				if (!hasQueuedSector())
+				{
+					queued = beginQueueSector(currentSector, bufferForSDRead);
+				}
+				restore_interrupts(irqState);
 			}
 			
 			if (menu_active && needFileCheckAction.Load() == picostation::FileListingStates::PROCESS_FILES && listReadyState.Load() && currentSector == 4750)
 			{
 				g_discImage.buildSector(currentSector - c_leadIn, pioSamples[bufferForSDRead], picostation::DirectoryListing::getFileListingData(), cdScramblingLUT);
+				passBusy = true;
 				needFileCheckAction = picostation::FileListingStates::IDLE;
 			}
 			else
 			{
-#if DEBUG_I2S
-				startTime = time_us_64();
-#endif
-				// Load the next sector
-				g_discImage.readSector(pioSamples[bufferForSDRead], currentSector - c_leadIn, s_dataLocation, cdScramblingLUT);
-#if DEBUG_I2S
-				endTime = time_us_64()-startTime;
-				
-				if (endTime > 5000)
-				{
-					DEBUG_PRINT("read time: %lluus (%d)\n", endTime, currentSector);
-				}
-#endif
+				// Load the next sector in the background, it is committed and handed to the IRQ once it is in
+				startRead(currentSector, bufferForSDRead, queued, true);
+				completeRead(false);
+				passBusy = true;
+				goto continue_transfer;
 			}
 			
-			loadedSector[bufferForSDRead] = currentSector;
-			bufferForDMA = bufferForSDRead;
+			m_sectorCache.commit(currentSector, bufferForSDRead);
+			setBufferForDMA(bufferForSDRead, currentSector);
 			lastSector = currentSector;
+			
+			if (queued)
+			{
+				finishQueueSector(queued);
+			}
 		}
 
 continue_transfer:
 
-        // Start the next transfer if the DMA channel is not busy
-        if (!dma_channel_is_busy(dmaChannel) && i2s_state)
+        // Keep the next sector queued behind the one being sent, the DMA IRQ chains into it without a gap.
+        // A sector the console has not moved past is only sent again once the chain has run dry.
+        if (i2s_state)
         {
-			if (currentSector >= 4650 && currentSector < c_sectorMax-2)
+			const uint32_t irqState = save_and_disable_interrupts();
+			
+			if (currentSector >= 4650 && currentSector < c_sectorMax-2 && bufferForDMA >= 0)
 			{
-				m_sectorSending = loadedSector[bufferForDMA];
-				m_lastSectorTime = time_us_64();
-
-				dma_hw->ch[dmaChannel].read_addr = (uint32_t)pioSamples[bufferForDMA];
-
-				// Sync with the I2S clock
-				while (gpio_get(Pin::LRCK) == 1)
+				if (!hasQueuedSector() && (sectorForDMA != m_queuedSector || isDMAIdle()))
 				{
-					tight_loop_contents();
+					queueSector(sectorForDMA, bufferForDMA);
+					passBusy = true;
 				}
-				
-				while (gpio_get(Pin::LRCK) == 0)
-				{
-					tight_loop_contents();
-				}
-
-				dma_channel_start(dmaChannel);
 			}
-			else if(picostation::g_subqDelay == false)
+			else if (isDMAIdle() && picostation::g_subqDelay == false)
 			{
 				m_sectorSending = currentSector;
 				m_lastSectorTime = time_us_64();
 			}
+			
+			restore_interrupts(irqState);
+        }
+        
+        // Read ahead of the console while the DMA is busy with the current sector,
+        // one sector in flight at a time so the loop stays responsive
+        if (!menu_active && currentSector == lastSector && currentSector >= 4650 && m_pendingRead.buffer < 0)
+        {
+            const int depth = prefetchDepth();
+            
+            if (m_prefetchSector <= currentSector || m_prefetchSector > currentSector + depth + 1)
+            {
+                m_prefetchSector = currentSector + 1;
+            }
+            
+            while (m_prefetchSector <= currentSector + depth && m_sectorCache.find(m_prefetchSector) >= 0)
+            {
+                m_prefetchSector++;
+            }
+            
+            if (m_prefetchSector <= currentSector + depth && m_prefetchSector < c_sectorMax-2)
+            {
+                const int buffer = m_sectorCache.reserve(m_prefetchSector);
+                
+                if (buffer >= 0)
+                {
+                    startRead(m_prefetchSector, buffer, nullptr, false);
+                    completeRead(false);
+                    passBusy = true;
+#if DEBUG_I2S0
+                    DEBUG_PRINT("prefetch %d\n", m_prefetchSector);
+#endif
+                }
+                m_prefetchSector++;
+            }
         }
+        
+        // Spare passes finish mapping the image onto the card, it has the bus to itself between reads
+        if (!passBusy && m_pendingRead.buffer < 0 && g_discImage.mapStep())
+        {
+            passBusy = true;
+        }
+        
+        // Passes with nothing to read or queue, time the sector handoff no longer takes from the loop
+        m_stats.loopPasses++;
+        if (!passBusy)
+        {
+            m_stats.idlePasses++;
+            m_stats.idleUs += time_us_64() - passStart;
+        }
+#if DEBUG_I2S
+        reportStats();
+#endif
     }
     __builtin_unreachable();
 }
@@ -5,44 +5,130 @@
 #include <array>
 
 #include "commons/pseudo_atomics.h"
+#include "commons/spsc_queue.h"
 #include "commands/mech_commands.h"
 #include "hardware/dma.h"
 #include "ff.h"
 #include "emulation/disc_image.h"
+#include "emulation/sector_cache.h"
 
-#define CACHED_SECS		32 /* Only 2, 4, 8, 16, 32 */
+#if PICO_RP2350
+#define CACHED_SECS_MAX		256 /* Sector buffers are sized from the free heap at boot, up to this */
+#else
+#define CACHED_SECS_MAX		96
+#endif
+#define SEEK_READAHEAD		4  /* Sectors read past a seek target before the console gets there */
+#define CACHED_SECS_MIN		12 /* Prefetch window plus the buffers pinned by the DMA */
+#define CACHE_HEAP_RESERVE	(32 * 1024) /* Left on the heap for the cue parser and directory listing */
+#define PREFETCH_DEPTH_1X	4  /* Sectors read ahead of the console at 1x */
+#define PREFETCH_DEPTH_2X	8  /* Sectors read ahead of the console at 2x */
+#define SD_PROFILE_AT_MOUNT	1  /* Time the card at mount and widen the prefetch window for slow ones, 0 to skip */
+#define SD_SLOW_KBPS		700 /* Sequential rate below which the menu flags a card as too slow for 2x */
+#define DMA_RING_SIZE		8  /* Control blocks in the I2S DMA ring, power of two */
+#define I2S_QUEUE_SIZE		4  /* Sectors handed from the SD reader to the DMA IRQ, power of two */
 
 namespace picostation {
 class I2S {
   public:
+    struct Stats
+    {
+        uint32_t loopPasses;
+        uint32_t idlePasses;    // Core1 passes with no SD read or queueing to do
+        uint64_t idleUs;
+        uint32_t dmaIRQs;
+        uint32_t underruns;     // Chain ran dry and was restarted
+    };
+    
     I2S() {};
     int dmaChannel;
+    int dmaCtrlChannel;
     bool menu_active;
     bool s_doorPending;
     
     void i2s_set_state(uint8_t state) { i2s_state = state; }
     int getSectorSending() { return m_sectorSending.Load(); }
     uint64_t getLastSectorTime() { return m_lastSectorTime.Load(); }
-	void reinitI2S() {
-		for (int i = 0; i < CACHED_SECS; i++) {
-			loadedSector[i] = -2;
-		}
-		lastSector = -1;
-		i2s_state = 0;
-	}
+    const Stats &getStats() const { return m_stats; }
+    int getCachedSectors() const { return m_cachedSectors; }
+    void postSeekHint(const int sector) { m_seekHint = sector; }  // Core0, once a jump has resolved its landing sector
+    bool getSentSubQ(const int sector, SubQ::Data &data);
+    void requestReinit();  // Core0, returns once core1 has dropped its cache and streaming state
+    void requestUnload();  // Core0, returns once core1 has swapped the mounted image for the menu
 
     [[noreturn]] void start(MechCommand &mechCommand);
+    void dmaIRQHandler();
 	
   private:
-    int initDMA(const volatile void *read_addr, unsigned int transfer_count);  // Returns DMA channel number
+    struct QueuedSector
+    {
+        int sector;
+        uint16_t buffer;
+        SubQ::Data subq;
+        volatile bool ready;    // Buffer filled, the IRQ may chain it
+    };
+    
+    struct SentSubQ
+    {
+        int sector;
+        SubQ::Data data;
+    };
+    
+    // The SD read in flight while the loop carries on
+    struct PendingRead
+    {
+        int sector;
+        int buffer;             // -1 when there is none
+        QueuedSector *queued;   // Released to the IRQ once the buffer is filled
+        bool demand;            // The console is waiting on it, not a prefetch
+    };
+    
+    void reinitI2S();
+    void initDMA(const volatile void *read_addr, unsigned int transfer_count);
+    uint32_t ringFetchIndex();
+    bool isDMAIdle();
+    bool isRingQueued();
+    bool hasQueuedSector();
+    QueuedSector *beginQueueSector(const int sector, const int buffer);
+    void finishQueueSector(QueuedSector *entry);
+    void queueSector(const int sector, const int buffer);
+    void appendToRing(const QueuedSector &entry);
+    void publishStartedSector();
+    void reportStats();
     void mountSDCard();
+    void allocateSectorBuffers();
+    int prefetchDepth();
+    size_t buildCardProfile(uint8_t *data);
+    void readAheadOfSeek(const int sector, const uint16_t *scramling);
 	
-	int loadedSector[CACHED_SECS];
+	SectorCache m_sectorCache;
+	int m_cachedSectors = 0;
 	int lastSector;
+	int m_prefetchSector;
+	int m_seekHintSeen = -1;
 	uint8_t i2s_state = 0;
+	PendingRead m_pendingRead = {-1, -1, nullptr, false};
+	pseudoatomic<bool> m_reinitPending;
+	pseudoatomic<bool> m_unloadPending;
+	
+	// Core1 loop produces, the DMA IRQ consumes
+	SPSCQueue<QueuedSector, I2S_QUEUE_SIZE> m_sectorQueue;
+	int m_queuedSector;
+	
+	// Sector and cache buffer behind each ring entry, -1 for a terminator. DMA IRQ only.
+	int m_ringSector[DMA_RING_SIZE];
+	int m_ringBuffer[DMA_RING_SIZE];
+	SubQ::Data m_ringSubQ[DMA_RING_SIZE];
+	uint32_t m_ringTail;
+	uint32_t m_ringPlaying;
+	
+	// The IRQ fills the slot core0 is not reading, then flips the index
+	SentSubQ m_sentSubQ[2];
+	pseudoatomic<int> m_sentSubQIndex;
+	Stats m_stats = {};
 	
     pseudoatomic<int> m_sectorSending;
     pseudoatomic<uint64_t> m_lastSectorTime;
+    pseudoatomic<int> m_seekHint;
 };
 }  // namespace picostation
 
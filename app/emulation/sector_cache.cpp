@@ -0,0 +1,130 @@
+// sector_cache.cpp - Set-associative sector index with LRU replacement inside each set.
+#include "sector_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+static constexpr int c_invalidSector = -2;
+
+void picostation::SectorCache::init(const size_t buffers)
+{
+    // Every line owns one buffer, the spares rotate in when a victim is still pinned
+    m_sets = buffers > SECTOR_CACHE_SPARES ? (buffers - SECTOR_CACHE_SPARES) / SECTOR_CACHE_WAYS : 0;
+    if (m_sets == 0)
+    {
+        panic("SectorCache: %u buffers is too few\n", (unsigned) buffers);
+    }
+
+    const size_t lines = m_sets * SECTOR_CACHE_WAYS;
+    m_lines = new Line[lines];
+    m_pinned = new uint8_t[buffers];
+    memset(m_pinned, 0, buffers);
+
+    for (size_t i = 0; i < lines; i++)
+    {
+        m_lines[i].buffer = i;
+    }
+
+    for (size_t i = 0; i < SECTOR_CACHE_SPARES; i++)
+    {
+        m_spares[i] = lines + i;
+    }
+
+    invalidate();
+}
+
+void __time_critical_func(picostation::SectorCache::invalidate)()
+{
+    if (!m_lines)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < capacity(); i++)
+    {
+        m_lines[i].sector = c_invalidSector;
+        m_lines[i].lastUse = 0;
+    }
+}
+
+int __time_critical_func(picostation::SectorCache::find)(const int sector)
+{
+    Line *set = getSet(sector);
+
+    for (size_t way = 0; way < SECTOR_CACHE_WAYS; way++)
+    {
+        if (set[way].sector == sector)
+        {
+            set[way].lastUse = ++m_useCounter;
+            return set[way].buffer;
+        }
+    }
+
+    return -1;
+}
+
+int __time_critical_func(picostation::SectorCache::reserve)(const int sector)
+{
+    Line *set = getSet(sector);
+    Line *victim = nullptr;
+
+    // Prefer an unpinned line, least recently used first
+    for (size_t way = 0; way < SECTOR_CACHE_WAYS; way++)
+    {
+        if (!m_pinned[set[way].buffer] && (!victim || set[way].lastUse < victim->lastUse))
+        {
+            victim = &set[way];
+        }
+    }
+
+    if (!victim)
+    {
+        // Whole set is in use by the DMA, swap the oldest line's buffer for a free spare
+        victim = &set[0];
+        for (size_t way = 1; way < SECTOR_CACHE_WAYS; way++)
+        {
+            if (set[way].lastUse < victim->lastUse)
+            {
+                victim = &set[way];
+            }
+        }
+
+        size_t spare = 0;
+        while (spare < SECTOR_CACHE_SPARES && m_pinned[m_spares[spare]])
+        {
+            spare++;
+        }
+
+        if (spare == SECTOR_CACHE_SPARES)
+        {
+            return -1;
+        }
+
+        const uint16_t buffer = m_spares[spare];
+        m_spares[spare] = victim->buffer;
+        victim->buffer = buffer;
+    }
+
+    // Not visible to find() until the buffer is filled
+    victim->sector = c_invalidSector;
+    victim->lastUse = ++m_useCounter;
+
+    return victim->buffer;
+}
+
+void __time_critical_func(picostation::SectorCache::commit)(const int sector, const int buffer)
+{
+    Line *set = getSet(sector);
+
+    for (size_t way = 0; way < SECTOR_CACHE_WAYS; way++)
+    {
+        if (set[way].buffer == buffer)
+        {
+            set[way].sector = sector;
+            return;
+        }
+    }
+}
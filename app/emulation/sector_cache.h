@@ -0,0 +1,59 @@
+// sector_cache.h - Tagged index mapping disc sectors to I2S sample buffers.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/sync.h"
+
+#ifndef SECTOR_CACHE_WAYS
+#define SECTOR_CACHE_WAYS		2	/* 1 = direct-mapped, 2 or 4 = set-associative */
+#endif
+
+#define SECTOR_CACHE_SPARES		2	/* Buffers kept outside the index for lines still owned by the DMA */
+
+namespace picostation {
+class SectorCache {
+  public:
+    SectorCache() {};
+
+    // Lookup, replacement and commit all cost O(SECTOR_CACHE_WAYS), independent of the buffer count.
+    void init(const size_t buffers);
+    void invalidate();
+    int find(const int sector);
+    int reserve(const int sector);
+    void commit(const int sector, const int buffer);
+
+    // Pinned buffers are never handed out by reserve(). The I2S DMA IRQ unpins too, so the counts change with IRQs off.
+    void pin(const int buffer)
+    {
+        const uint32_t irqState = save_and_disable_interrupts();
+        m_pinned[buffer]++;
+        restore_interrupts(irqState);
+    }
+    void unpin(const int buffer)
+    {
+        const uint32_t irqState = save_and_disable_interrupts();
+        m_pinned[buffer]--;
+        restore_interrupts(irqState);
+    }
+
+    size_t capacity() const { return m_sets * SECTOR_CACHE_WAYS; }
+
+  private:
+    struct Line
+    {
+        int sector;
+        uint16_t buffer;
+        uint32_t lastUse;
+    };
+
+    Line *getSet(const int sector) { return &m_lines[(uint32_t) sector % m_sets * SECTOR_CACHE_WAYS]; }
+
+    Line *m_lines = nullptr;
+    uint8_t *m_pinned = nullptr;
+    uint16_t m_spares[SECTOR_CACHE_SPARES];
+    uint32_t m_sets = 0;
+    uint32_t m_useCounter = 0;
+};
+}  // namespace picostation
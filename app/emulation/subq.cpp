@@ -26,8 +26,10 @@ void picostation::SubQ::printf_subq(const uint8_t *data) {
 }
 
 void __time_critical_func(picostation::SubQ::start_subq)(const int sector) {
-    const SubQ::Data tracksubq = m_discImage->generateSubQ(sector);
-    
+    start_subq(sector, m_discImage->generateSubQ(sector));
+}
+
+void __time_critical_func(picostation::SubQ::start_subq)(const int sector, const Data &tracksubq) {
     if (!g_driveMechanics.isSledStopped())
 	{
 		return;
@@ -38,6 +38,7 @@ class SubQ {
 
     SubQ(DiscImage *discImage) : m_discImage(discImage) {}
     void start_subq(const int sector);
+    void start_subq(const int sector, const Data &tracksubq);
     //void stop_subq();
 
   private:
@@ -169,8 +169,17 @@ static void __time_critical_func(mech_irq_hnd)()
 static void __time_critical_func(send_subq)(const int currentSector)
 {
 	picostation::SubQ subq(&picostation::g_discImage);
+	picostation::SubQ::Data tracksubq;
 	
-	subq.start_subq(currentSector);
+	// Core1 works the SubQ out when it queues the sector, fall back for sectors it never sends
+	if (m_i2s.getSentSubQ(currentSector, tracksubq))
+	{
+		subq.start_subq(currentSector, tracksubq);
+	}
+	else
+	{
+		subq.start_subq(currentSector);
+	}
 	picostation::g_subqDelay = false;
 }
 
@@ -299,7 +308,7 @@ void picostation::initHW()
     initPWM(&pwmLRClock);
 
     uint32_t i2s_pio_offset = pio_add_program(PIOInstance::I2S_DATA, &i2s_data_program);
-    i2s_data_program_init(PIOInstance::I2S_DATA, SM::I2S_DATA, i2s_pio_offset, Pin::DA15, Pin::DA16);
+    i2s_data_program_init(PIOInstance::I2S_DATA, SM::I2S_DATA, i2s_pio_offset, Pin::DA15, Pin::DA16, Pin::LRCK);
 
     s_mechachonOffset = pio_add_program(PIOInstance::MECHACON, &mechacon_program);
     mechacon_program_init(PIOInstance::MECHACON, SM::MECHACON, s_mechachonOffset, Pin::CMD_DATA);
@@ -402,9 +411,7 @@ void __time_critical_func(picostation::reset)()
     {
         if (s_dataLocation != picostation::DiscImage::DataLocation::RAM)
 		{
-			g_discImage.unload();
-			g_discImage.makeDummyCue();
-			m_i2s.menu_active = true;
+			m_i2s.requestUnload();
 		}
 		picostation::DirectoryListing::gotoRoot();
 		s_dataLocation = picostation::DiscImage::DataLocation::RAM;
@@ -417,7 +424,7 @@ void __time_critical_func(picostation::reset)()
     gpio_put(Pin::SCOR, 0);
     gpio_put(Pin::SQSO, 0);
 	g_driveMechanics.resetDrive();
-	m_i2s.reinitI2S();
+	m_i2s.requestReinit();
 	
 	uint64_t startTime = time_us_64();
 	
@@ -23,6 +23,7 @@ enum class FileListingStates {
     GET_NEXT_CONTENTS,
     MOUNT_FILE,
     PROCESS_FILES,
+    GET_CARD_PROFILE,
 };
 
 extern pseudoatomic<FileListingStates> g_fileListingState;
@@ -175,6 +175,10 @@ uint16_t* DirectoryListing::getFileListingData() {
     return fileListing->getData();
 }
 
+void DirectoryListing::setListingData(const uint8_t* data, const size_t size) {
+    fileListing->setData(data, size);
+}
+
 // Private
 
 void DirectoryListing::combinePaths(const char* filePath1, const char* filePath2, char* newPath) { 
@@ -0,0 +1,10 @@
+// pio.h - Host stand-in, only the instance handles named in commons/values.h.
+#pragma once
+
+#include "pico.h"
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t *PIO;
+
+#define pio0 ((PIO) 0x50200000u)
+#define pio1 ((PIO) 0x50300000u)
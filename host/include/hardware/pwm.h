@@ -0,0 +1,11 @@
+// pwm.h - Host stand-in, only the config type named in picostation.h.
+#pragma once
+
+#include "pico.h"
+
+typedef struct
+{
+    uint32_t csr;
+    uint32_t div;
+    uint32_t top;
+} pwm_config;
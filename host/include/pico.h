@@ -0,0 +1,27 @@
+// pico.h - Host stand-in for the pico-sdk platform header, enough for the storage path to build on a PC.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef PICO_NO_HARDWARE
+#define PICO_NO_HARDWARE 1
+#endif
+
+#define __time_critical_func(x) x
+#define __not_in_flash_func(x) x
+
+typedef unsigned int uint;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void panic(const char *fmt, ...) __attribute__((noreturn));
+
+static inline void tight_loop_contents(void) {}
+
+#ifdef __cplusplus
+}
+#endif
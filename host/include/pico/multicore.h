@@ -0,0 +1,9 @@
+// multicore.h - Host stand-in, the host build runs everything on one thread.
+#pragma once
+
+#include "pico.h"
+
+typedef struct
+{
+    int owner;
+} mutex_t;
@@ -0,0 +1,5 @@
+// stdlib.h - Host stand-in for the pico-sdk convenience header.
+#pragma once
+
+#include "pico.h"
+#include "pico/time.h"
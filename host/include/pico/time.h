@@ -0,0 +1,21 @@
+// time.h - Host clock, wall time plus the delays charged by the SD card model.
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t time_us_64(void);
+static inline uint32_t time_us_32(void) { return (uint32_t) time_us_64(); }
+
+// Moves the clock forward without sleeping, so modelled card latency costs no real time
+void host_clock_advance(uint64_t us);
+
+void sleep_us(uint64_t us);
+static inline void sleep_ms(uint32_t ms) { sleep_us((uint64_t) ms * 1000); }
+
+#ifdef __cplusplus
+}
+#endif
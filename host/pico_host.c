@@ -0,0 +1,46 @@
+// pico_host.c - Clock and panic for the host build.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pico.h"
+#include "pico/time.h"
+
+static uint64_t s_clockOffset = 0;
+
+uint64_t time_us_64(void)
+{
+    static uint64_t start = 0;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t now = (uint64_t) ts.tv_sec * 1000000u + ts.tv_nsec / 1000u;
+    if (!start)
+    {
+        start = now;
+    }
+
+    return now - start + s_clockOffset;
+}
+
+void host_clock_advance(uint64_t us)
+{
+    s_clockOffset += us;
+}
+
+// Firmware sleeps are waits on hardware, which the host doesn't have
+void sleep_us(uint64_t us)
+{
+    host_clock_advance(us);
+}
+
+void panic(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    abort();
+}
@@ -0,0 +1,397 @@
+// sd_bench.cpp - Streams a cue sheet off a disk image through DiscImage and reports SD throughput and latency.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "commons/values.h"
+#include "disc_image.h"
+#include "ff.h"
+#include "pico/time.h"
+#include "sd_image.h"
+#include "sd_spi.h"
+
+int c_sectorMax = 333000;  // 74:00:00
+
+namespace {
+struct Options
+{
+    const char *image = nullptr;
+    const char *cue = nullptr;
+    sd_image_model_t model = SD_IMAGE_MODEL_DEFAULT;
+    uint32_t sectors = 20000;   // Sequential sectors read from the start of the program area
+    uint32_t seeks = 200;       // Random seeks, each followed by a short burst
+    uint32_t burst = 16;        // Sectors read after each seek
+    uint32_t interleave = 2000; // Sectors read taking turns between two streams, like data and CDDA
+    uint32_t passUs = 20;       // Work the I2S loop does between two polls
+    bool sync = false;          // Blocking reads instead of the polled path
+    bool verify = false;        // Check every sector against a plain FatFs read of its track file
+    uint64_t maxLatencyUs = 0;  // Fail when a sector takes longer, 0 to only report
+    uint32_t minRate = 0;       // Fail below this many sectors per second, 0 to only report
+};
+
+struct Result
+{
+    const char *name;
+    std::vector<uint32_t> latencies;
+    uint64_t elapsedUs = 0;
+};
+
+uint16_t s_buffer[c_cdSamplesSize * 2] __attribute__((aligned(4)));
+uint8_t s_reference[c_cdSamplesBytes] __attribute__((aligned(4)));
+uint32_t s_verified = 0;
+uint32_t s_mismatches = 0;
+
+// Descrambling costs the same whatever the key, so a blank table stands in for the I2S one
+uint16_t s_scramblingLUT[c_cdSamplesSize * 2];
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] <image> <cue>\n"
+            "  --sectors N        sequential sectors to read (%u)\n"
+            "  --seeks N          random seeks (%u), each followed by --burst N sectors (%u)\n"
+            "  --interleave N     sectors read alternating between two streams (%u)\n"
+            "  --cmd-us N         stream open latency (%u)\n"
+            "  --block-us N       time per 512 byte block (%u)\n"
+            "  --stall-ppm N      stall chance per block, parts per million (%u)\n"
+            "  --stall-us N       stall length (%u)\n"
+            "  --seed N           stall pattern seed (%u)\n"
+            "  --pass-us N        loop time between polls (%u)\n"
+            "  --sync             use blocking reads, which spin on the wall clock\n"
+            "  --verify           compare every sector with a plain f_lseek + f_read of its file and\n"
+            "                     exit with an error on a mismatch, timings are off while it runs\n"
+            "  --max-latency-us N exit with an error if any sector takes longer\n"
+            "  --min-rate N       exit with an error below N sectors per second\n",
+            argv0, Options().sectors, Options().seeks, Options().burst, Options().interleave, Options().model.cmd_us,
+            Options().model.block_us, Options().model.stall_ppm, Options().model.stall_us, Options().model.seed,
+            Options().passUs);
+}
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    struct Numeric
+    {
+        const char *name;
+        uint32_t *value;
+    } numerics[] = {
+        {"--sectors", &options.sectors},         {"--seeks", &options.seeks},
+        {"--burst", &options.burst},             {"--cmd-us", &options.model.cmd_us},
+        {"--block-us", &options.model.block_us}, {"--stall-ppm", &options.model.stall_ppm},
+        {"--stall-us", &options.model.stall_us}, {"--seed", &options.model.seed},
+        {"--pass-us", &options.passUs},          {"--min-rate", &options.minRate},
+        {"--interleave", &options.interleave},
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+
+        if (!strcmp(arg, "--sync"))
+        {
+            options.sync = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--verify"))
+        {
+            options.verify = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--max-latency-us") && i + 1 < argc)
+        {
+            options.maxLatencyUs = strtoull(argv[++i], nullptr, 0);
+            continue;
+        }
+
+        bool matched = false;
+        for (const Numeric &numeric : numerics)
+        {
+            if (!strcmp(arg, numeric.name) && i + 1 < argc)
+            {
+                *numeric.value = strtoul(argv[++i], nullptr, 0);
+                matched = true;
+                break;
+            }
+        }
+
+        if (matched)
+        {
+            continue;
+        }
+
+        if (arg[0] == '-')
+        {
+            return false;
+        }
+
+        if (!options.image)
+        {
+            options.image = arg;
+        }
+        else if (!options.cue)
+        {
+            options.cue = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.image && options.cue;
+}
+
+// The bytes readSectorSD serves for a sector, found the way it finds them but read through plain FatFs.
+// The link map is set aside so the FAT chain is walked independently of the extent and fast seek tables.
+// False for sectors DiscImage makes up itself: the loader, and anything without a file behind it.
+bool readReference(const int sector, uint8_t *data)
+{
+    const CueDisc &disc = picostation::g_discImage.getCueDisc();
+    const int adjustedSector = sector - c_preGap;
+    if (adjustedSector < 0 || (adjustedSector < 16 && disc.tracks[1].trackType == CueTrackType::TRACK_TYPE_DATA))
+    {
+        return false;
+    }
+
+    for (int i = 1; i <= (int) disc.trackCount; i++)
+    {
+        if (adjustedSector >= (int) disc.tracks[i + 1].indices[0] || !disc.tracks[i].file || !disc.tracks[i].file->opaque)
+        {
+            continue;
+        }
+
+        const int64_t seekBytes = (int64_t) (adjustedSector - (int) disc.tracks[i].fileOffset) * c_cdSamplesBytes;
+        if (seekBytes < 0)
+        {
+            return false;
+        }
+
+        FIL *fp = (FIL *) disc.tracks[i].file->opaque;
+        DWORD *const cltbl = fp->cltbl;
+        fp->cltbl = nullptr;
+        UINT br = 0;
+        const bool read = FR_OK == f_lseek(fp, seekBytes) && FR_OK == f_read(fp, data, c_cdSamplesBytes, &br);
+        fp->cltbl = cltbl;
+
+        return read && br == c_cdSamplesBytes;
+    }
+
+    return false;
+}
+
+void verifySector(const int sector)
+{
+    if (!readReference(sector, s_reference))
+    {
+        return;
+    }
+
+    s_verified++;
+    if (memcmp(s_buffer, s_reference, c_cdSamplesBytes))
+    {
+        if (s_mismatches++ < 10)
+        {
+            size_t at = 0;
+            while (((const uint8_t *) s_buffer)[at] == s_reference[at])
+            {
+                at++;
+            }
+            fprintf(stderr, "sector %d differs from its file at byte %zu\n", sector, at);
+        }
+    }
+}
+
+uint32_t readOne(const Options &options, const int sector)
+{
+    // The spare pass the I2S loop gets between two sectors
+    picostation::g_discImage.mapStep();
+
+    const uint64_t start = time_us_64();
+
+    if (options.sync)
+    {
+        picostation::g_discImage.readSector(s_buffer, sector, picostation::DiscImage::SDCard, s_scramblingLUT);
+    }
+    else if (picostation::g_discImage.startReadSector(s_buffer, sector, picostation::DiscImage::SDCard,
+                                                       s_scramblingLUT))
+    {
+        while (!picostation::g_discImage.pollRead())
+        {
+            host_clock_advance(options.passUs);
+        }
+    }
+
+    const uint32_t latency = (uint32_t) (time_us_64() - start);
+
+    if (options.verify)
+    {
+        verifySector(sector);
+    }
+
+    return latency;
+}
+
+void report(const Result &result)
+{
+    if (result.latencies.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> sorted = result.latencies;
+    std::sort(sorted.begin(), sorted.end());
+
+    uint64_t total = 0;
+    for (const uint32_t latency : sorted)
+    {
+        total += latency;
+    }
+
+    const double rate = result.elapsedUs ? sorted.size() * 1e6 / result.elapsedUs : 0;
+    printf("%-10s %8zu sectors %9.1f sectors/s (%.1fx)  latency avg %u us, p99 %u us, max %u us\n", result.name,
+           sorted.size(), rate, rate / 75, (uint32_t) (total / sorted.size()), sorted[sorted.size() * 99 / 100],
+           sorted.back());
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (sd_image_open(options.image, &options.model))
+    {
+        fprintf(stderr, "cannot open %s\n", options.image);
+        return 1;
+    }
+
+    static FATFS fs;
+    FRESULT fr = f_mount(&fs, "", 1);
+    if (FR_OK != fr)
+    {
+        fprintf(stderr, "f_mount error: (%d)\n", fr);
+        return 1;
+    }
+
+    // The same calibration the firmware runs at mount, over the data area of the volume
+    if (!sd_profile_card(fs.database, (fs.n_fatent - 2) * fs.csize))
+    {
+        const sd_card_profile_t *profile = sd_get_card_profile();
+        printf("profile    %lu KB/s, 4K random %lu us (max %lu), CMD17 %lu us, CMD18 %lu us\n",
+               (unsigned long) profile->seq_kbps, (unsigned long) profile->rand_us,
+               (unsigned long) profile->rand_max_us, (unsigned long) profile->cmd17_us,
+               (unsigned long) profile->cmd18_us);
+    }
+
+    const uint64_t loadStart = time_us_64();
+    fr = picostation::g_discImage.load(options.cue);
+    if (FR_OK != fr)
+    {
+        fprintf(stderr, "load error: (%d)\n", fr);
+        return 1;
+    }
+    printf("load       %llu us\n", (unsigned long long) (time_us_64() - loadStart));
+
+    // Start of the program area, numbered the way the I2S loop asks once it has taken off the lead-in
+    const int first = c_preGap;
+    const int last = c_sectorMax - 4652;
+    if (last <= first)
+    {
+        fprintf(stderr, "%s has no sectors to read\n", options.cue);
+        return 1;
+    }
+
+    const sd_read_stats_t before = *sd_get_read_stats();
+
+    Result sequential = {"sequential"};
+    uint64_t start = time_us_64();
+    for (uint32_t i = 0; i < options.sectors && first + (int) i < last; i++)
+    {
+        sequential.latencies.push_back(readOne(options, first + i));
+        if (i == 0)
+        {
+            printf("first      sector %llu us after load started\n", (unsigned long long) (time_us_64() - loadStart));
+        }
+    }
+    sequential.elapsedUs = time_us_64() - start;
+
+    Result seek = {"seek"};
+    uint32_t lcg = options.model.seed ? options.model.seed : 1;
+    start = time_us_64();
+    for (uint32_t i = 0; i < options.seeks; i++)
+    {
+        lcg = lcg * 1664525u + 1013904223u;
+        const int target = first + (int) (lcg % (uint32_t) (last - first));
+        for (uint32_t j = 0; j < options.burst && target + (int) j < last; j++)
+        {
+            seek.latencies.push_back(readOne(options, target + j));
+        }
+    }
+    seek.elapsedUs = time_us_64() - start;
+
+    // One stream from the start of the program area, the other from half way, e.g. a game's data
+    // track and the CDDA file it plays from
+    Result interleave = {"interleave"};
+    const int second = first + (last - first) / 2;
+    start = time_us_64();
+    for (uint32_t i = 0; i < options.interleave && second + (int) (i / 2) < last; i++)
+    {
+        interleave.latencies.push_back(readOne(options, (i & 1 ? second : first) + (int) (i / 2)));
+    }
+    interleave.elapsedUs = time_us_64() - start;
+
+    report(sequential);
+    report(seek);
+    report(interleave);
+
+    const sd_read_stats_t &after = *sd_get_read_stats();
+    printf("sd         %llu KB, %lu streams, %llu us busy, %llu us waiting\n",
+           (unsigned long long) ((after.bytes - before.bytes) / 1024), (unsigned long) (after.streams - before.streams),
+           (unsigned long long) (after.total_us - before.total_us), (unsigned long long) (after.wait_us - before.wait_us));
+
+    picostation::g_discImage.unload();
+    sd_image_close();
+
+    if (options.verify)
+    {
+        printf("verify     %u sectors, %u mismatches\n", s_verified, s_mismatches);
+        if (s_mismatches)
+        {
+            fprintf(stderr, "%u sectors did not match their files\n", s_mismatches);
+            return 1;
+        }
+    }
+
+    uint32_t worst = 0;
+    for (const Result *result : {&sequential, &seek, &interleave})
+    {
+        for (const uint32_t latency : result->latencies)
+        {
+            worst = std::max(worst, latency);
+        }
+    }
+
+    if (options.maxLatencyUs && worst > options.maxLatencyUs)
+    {
+        fprintf(stderr, "worst sector latency %u us is over %llu us\n", worst,
+                (unsigned long long) options.maxLatencyUs);
+        return 1;
+    }
+
+    const double rate = sequential.elapsedUs ? sequential.latencies.size() * 1e6 / sequential.elapsedUs : 0;
+    if (options.minRate && rate < options.minRate)
+    {
+        fprintf(stderr, "sequential rate %.1f sectors/s is under %u\n", rate, options.minRate);
+        return 1;
+    }
+
+    return 0;
+}
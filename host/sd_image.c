@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "pico/time.h"
+#include "ff.h"			/* Obtains integer types */
+#include "diskio.h"		/* Declarations of disk functions */
+#include "sd_spi.h"
+#include "sd_image.h"
+
+/* Stand-in for sd_spi.c on a PC. Blocks come from an image file and every read is charged the
+   time the modelled card would take, so the code above disk_read sees the same stream and
+   stall behaviour it would on the Pico, without a card or a bus. */
+
+static FILE *image = NULL;
+static LBA_t image_blocks = 0;
+static sd_image_model_t model = SD_IMAGE_MODEL_DEFAULT;
+static uint32_t rng_state;
+
+static bool initted = false;
+
+/* The modelled card keeps a CMD18 stream open between reads like the real driver does */
+static bool stream_open = false;
+static uint32_t stream_next;
+
+static sd_card_info_t card;
+static sd_read_stats_t read_stats;
+
+/* The read in progress, its next block lands once the clock reaches ready */
+static struct {
+    bool busy;
+    int result;
+    uint32_t block;
+    size_t count;
+    uint8_t *buf;
+    const uint16_t *sc;
+    uint64_t ready;
+    sd_read_cb_t cb;
+    void *ctx;
+} req;
+
+int sd_image_open(const char *path, const sd_image_model_t *m) {
+    sd_image_close();
+
+    image = fopen(path, "rb");
+    if(!image) {
+        return -1;
+    }
+
+    fseek(image, 0, SEEK_END);
+    image_blocks = (LBA_t) ftell(image) / 512;
+
+    if(m) {
+        model = *m;
+    }
+    rng_state = model.seed ? model.seed : 1;
+
+    memset(&card, 0, sizeof(card));
+    memcpy(&card.cid[3], "IMAGE", 5);	/* Product name field */
+    card.baud = model.block_us ? (uint32_t) (512ull * 8 * 1000000 / model.block_us) : 0;
+
+    return 0;
+}
+
+void sd_image_close(void) {
+    if(image) {
+        fclose(image);
+        image = NULL;
+    }
+
+    initted = false;
+    stream_open = false;
+    req.busy = false;
+}
+
+int sd_init(void) {
+    if(!image) {
+        return -1;
+    }
+
+    stream_open = false;
+    initted = true;
+
+    return 0;
+}
+
+const sd_read_stats_t *sd_get_read_stats(void) {
+    return &read_stats;
+}
+
+const sd_card_info_t *sd_get_card_info(void) {
+    return &card;
+}
+
+/* xorshift32, the stall pattern only has to be repeatable */
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* Time until the block at req.block is on the host side, opening the stream first if needed */
+static uint64_t block_time(void) {
+    uint64_t us = model.block_us;
+
+    if(!stream_open) {
+        stream_open = true;
+        stream_next = req.block;
+        ++read_stats.streams;
+        us += model.cmd_us;
+    }
+
+    if(model.stall_ppm && next_random() % 1000000 < model.stall_ppm) {
+        us += model.stall_us;
+    }
+
+    return us;
+}
+
+static void read_finish(int rv) {
+    if(rv) {
+        stream_open = false;
+    }
+
+    req.result = rv;
+    req.busy = false;
+
+    if(req.cb) {
+        req.cb(rv, req.ctx);
+    }
+}
+
+/* Delivers every block whose time has come, or all of them with wait set */
+static int read_step(bool wait) {
+    uint64_t start = time_us_64();
+    uint64_t now;
+
+    while(req.busy) {
+        now = time_us_64();
+        if(now < req.ready) {
+            if(!wait) {
+                break;
+            }
+
+            host_clock_advance(req.ready - now);
+            read_stats.wait_us += req.ready - now;
+        }
+
+        if(req.block >= image_blocks || fseek(image, (long) req.block * 512, SEEK_SET) ||
+           fread(req.buf, 512, 1, image) != 1) {
+            read_finish(-1);
+            break;
+        }
+
+        if(req.sc) {
+            scramble_data((uint16_t *) req.buf, (uint16_t *) req.buf, req.sc, 256);
+            req.sc += 256;
+        }
+
+        read_stats.bytes += 512;
+        ++stream_next;
+        ++req.block;
+        --req.count;
+        req.buf += 512;
+
+        if(!req.count) {
+            read_finish(0);
+            break;
+        }
+
+        req.ready = time_us_64() + block_time();
+    }
+
+    read_stats.total_us += time_us_64() - start;
+
+    return req.busy ? 1 : req.result;
+}
+
+int sd_read_start(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt,
+                  sd_read_cb_t cb, void *ctx) {
+    if(!initted) {
+        return -1;
+    }
+
+    while(req.busy) {
+        read_step(true);
+    }
+
+    if(stream_open && block != stream_next) {
+        stream_open = false;
+    }
+
+    req.busy = true;
+    req.block = block;
+    req.count = count;
+    req.buf = buf;
+    req.sc = dt ? sc : NULL;
+    req.cb = cb;
+    req.ctx = ctx;
+
+    if(!count) {
+        read_finish(0);
+        return 0;
+    }
+
+    req.ready = time_us_64() + block_time();
+
+    return 0;
+}
+
+int sd_read_poll(void) {
+    return read_step(false);
+}
+
+void sd_stream_close(void) {
+    while(req.busy) {
+        read_step(true);
+    }
+
+    stream_open = false;
+}
+
+int sd_read_blocks(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt) {
+    if(sd_read_start(block, count, buf, sc, dt, NULL, NULL)) {
+        return -1;
+    }
+
+    return read_step(true);
+}
+
+static sd_card_profile_t profile;
+
+/* Same access patterns as the driver. The model has no separate CMD17 cost, both single block
+   figures come from one stream opened and stopped for the block. */
+int sd_profile_card(uint32_t first, uint32_t count) {
+    static uint8_t buf[512];
+    const sd_read_stats_t stats = read_stats;
+    uint32_t seed = 1, block, i, j;
+    uint64_t start, us, total = 0;
+    int rv = 0;
+
+    if(!initted || count < 256) {
+        return -1;
+    }
+
+    memset(&profile, 0, sizeof(profile));
+    sd_stream_close();
+
+    start = time_us_64();
+    for(i = 0; i < 256 && !rv; ++i) {
+        rv = sd_read_blocks(first + i, 1, buf, NULL, 0);
+    }
+    sd_stream_close();
+    us = time_us_64() - start;
+    profile.seq_kbps = us ? (uint32_t) (256ull * 500000 / us) : 0;
+
+    for(i = 0; i < 16 && !rv; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        block = first + ((seed >> 8) % (count / 8)) * 8;
+
+        start = time_us_64();
+        for(j = 0; j < 8 && !rv; ++j) {
+            rv = sd_read_blocks(block + j, 1, buf, NULL, 0);
+        }
+        sd_stream_close();
+        us = time_us_64() - start;
+
+        total += us;
+        if(us > profile.rand_max_us) {
+            profile.rand_max_us = (uint32_t) us;
+        }
+    }
+    profile.rand_us = (uint32_t) (total / 16);
+
+    for(i = 0, total = 0; i < 16 && !rv; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        start = time_us_64();
+        rv = sd_read_blocks(first + (seed >> 8) % count, 1, buf, NULL, 0);
+        sd_stream_close();
+        total += time_us_64() - start;
+    }
+    profile.cmd17_us = profile.cmd18_us = (uint32_t) (total / 16);
+
+    read_stats = stats;
+
+    if(rv) {
+        memset(&profile, 0, sizeof(profile));
+        return -1;
+    }
+
+    return 0;
+}
+
+const sd_card_profile_t *sd_get_card_profile(void) {
+    return &profile;
+}
+
+/*-----------------------------------------------------------------------*/
+/* FatFs glue, same contract as the one in sd_spi.c                      */
+/*-----------------------------------------------------------------------*/
+
+/* There is no metadata cache here, FAT and directory blocks are charged as card reads */
+
+DSTATUS disk_status()
+{
+    return initted ? RES_OK : STA_NOINIT;
+}
+
+DSTATUS disk_initialize() {
+	if(sd_init()) {
+		return RES_NOTRDY;
+	}
+
+    return initted ? RES_OK : STA_NOINIT;
+}
+
+DRESULT disk_read( BYTE *buff,     /* Data buffer to store read data */
+				   LBA_t sector,   /* Start sector in LBA */
+				   UINT  count,    /* Number of sectors to read */
+				   const WORD* sc, /* Buffer with scramble table */
+				   BYTE  dt	       /* Data type */
+)
+{
+    if(sd_read_blocks(sector, count, buff, sc, dt & ~DT_STREAM)) {
+		return RES_ERROR;
+	}
+
+    return RES_OK;
+}
+
+static DISK_CB disk_cb;
+static void *disk_cb_ctx;
+
+static void disk_read_done(int result, void *ctx) {
+    (void) ctx;
+
+    if(disk_cb) {
+        disk_cb(result ? RES_ERROR : RES_OK, disk_cb_ctx);
+    }
+}
+
+DRESULT disk_read_async( BYTE *buff,     /* Data buffer to store read data */
+						 LBA_t sector,   /* Start sector in LBA */
+						 UINT  count,    /* Number of sectors to read */
+						 const WORD* sc, /* Buffer with scramble table */
+						 BYTE  dt,	     /* Data type */
+						 DISK_CB cb,     /* Called from disk_poll once the read is done */
+						 void* ctx
+)
+{
+    /* A read still in progress completes first, its callback must see its own context */
+    while(req.busy) {
+        read_step(true);
+    }
+
+    disk_cb = cb;
+    disk_cb_ctx = ctx;
+
+    if(sd_read_start(sector, count, buff, sc, dt & ~DT_STREAM, disk_read_done, NULL)) {
+        return RES_ERROR;
+    }
+
+    return RES_OK;
+}
+
+int disk_poll(void) {
+    return sd_read_poll() > 0;
+}
+
+DRESULT disk_ioctl(BYTE cmd,  /* Control code */
+				   void *buff /* Buffer to send/receive control data */
+)
+{
+	switch (cmd) {
+        case GET_SECTOR_COUNT: {
+            *(LBA_t *)buff = image_blocks;
+            return RES_OK;
+        }
+
+        case GET_BLOCK_SIZE: {
+            *(DWORD *)buff = 1;
+            return RES_OK;
+        }
+
+        case CTRL_SYNC: {
+            sd_stream_close();
+            return RES_OK;
+		}
+
+        default:
+            return RES_PARERR;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef _SD_IMAGE_DEFINED
+#define _SD_IMAGE_DEFINED
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Timing of the modelled card, charged to the host clock as blocks are read */
+typedef struct {
+	uint32_t cmd_us;	/* CMD18 and access latency, paid by every new stream */
+	uint32_t block_us;	/* Transfer time of one 512 byte block */
+	uint32_t stall_ppm;	/* Chance per block of an internal stall, in parts per million */
+	uint32_t stall_us;	/* Length of a stall */
+	uint32_t seed;		/* Stall pattern, the same seed gives the same run */
+} sd_image_model_t;
+
+/* 30 MHz SPI to a typical class 10 card */
+#define SD_IMAGE_MODEL_DEFAULT { 500, 150, 200, 20000, 1 }
+
+/* Serves sd_read_blocks and the disk_* layer from a FAT32 or exFAT image file */
+int sd_image_open(const char *path, const sd_image_model_t *model);
+void sd_image_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
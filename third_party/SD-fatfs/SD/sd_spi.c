@@ -3,11 +3,17 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "hardware/spi.h"
 #include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "pico/time.h"
 #include "ff.h"			/* Obtains integer types */
 #include "diskio.h"		/* Declarations of disk functions */
 #include "picostation_pinout.h"
+#include "sd_spi.h"
+#include "main.pio.h"
 
 #define MAX_RETRIES     500000
 #define READ_RETRIES    50000
@@ -21,6 +27,35 @@
 #define SPI_FILL_CHAR (0xFF)
 
 #define SD_BAUD_RATE (30 * 1000 * 1000)
+#define SD_HS_BAUD_RATE (50 * 1000 * 1000)
+
+#define PROBE_BLOCKS    32  /* Blocks read at each rung of the clock ladder */
+#define KNOWN_CARDS     4   /* Cards whose rate is remembered since boot */
+
+#define PROFILE_SEQ_BLOCKS  256 /* Blocks streamed for the sequential rate, 128 KB */
+#define PROFILE_SAMPLES     16  /* Random reads timed for each access pattern */
+
+/* Check every data block against its CRC16, computed by the DMA sniffer on the RX channel */
+#ifndef SD_DATA_CRC
+#define SD_DATA_CRC     1
+#endif
+
+#define CRC_RETRIES     3   /* Re-reads of a block failing its CRC before giving up */
+
+/* Clock data blocks in with a PIO state machine instead of SPI1, which only divides clk_peri
+   by even numbers. Commands and the start token still go through SPI1. */
+#ifndef SD_PIO_SPI
+#define SD_PIO_SPI      0
+#endif
+
+/* Single-block reads without a scramble table come from fs->win: FAT, bitmap and directory
+   blocks. A few of them are kept here so browsing and chain walks don't go back to the card. */
+#ifndef SD_META_BLOCKS
+#define SD_META_BLOCKS  8
+#endif
+
+#define SD_PIO          pio1
+#define SD_PIO_SM       1   /* SM 0 is the I2S data */
 
 #define spi_set_cs(val) gpio_put(GPIO_SD_CS, val);
 
@@ -28,6 +63,45 @@ static bool byte_mode = false;
 static bool is_mmc = false;
 static bool initted = false;
 
+/* A CMD18 read is left open between calls so sequential reads skip the command and access latency.
+   The card only shifts data out when clocked, so an idle open stream costs nothing but the held /CS. */
+static bool stream_open = false;
+static uint32_t stream_next;	/* Next block the open stream will deliver */
+
+static sd_card_info_t card;
+
+/* Clock ladder tried at mount, highest first. Cards without high speed mode start at SD_BAUD_RATE. */
+static const uint32_t baud_ladder[] = {
+    50 * 1000 * 1000, 45 * 1000 * 1000, 40 * 1000 * 1000, 33 * 1000 * 1000,
+    30 * 1000 * 1000, 25 * 1000 * 1000, 20 * 1000 * 1000, 12 * 1000 * 1000
+};
+
+/* Rates already probed, keyed by CID, so a remount of the same card skips the ladder */
+static struct {
+    uint8_t cid[16];
+    uint32_t baud;
+} known_cards[KNOWN_CARDS];
+static size_t known_next = 0;
+
+static uint8_t probe_buf[512];
+
+static sd_card_profile_t profile;
+
+/* Isolated metadata reads use CMD17 when the profile found it cheaper than opening and stopping a stream */
+static bool meta_cmd17 = false;
+
+/* LRU metadata cache, an entry with last_use 0 is empty */
+static struct {
+    uint32_t block;
+    uint32_t last_use;
+    uint8_t data[512];
+} meta_cache[SD_META_BLOCKS];
+static uint32_t meta_clock = 0;
+
+static void sd_dma_init(void);
+static void sd_meta_invalidate(void);
+static void sd_set_speed(void);
+
 /* Table/algorithm generated by pycrc. I really wanted to have a much smaller
    table here, but unfortunately, the code pycrc generated just did not work. */
 static uint8_t crc7_table[256] = {
@@ -195,7 +269,9 @@ int __not_in_flash_func(sd_init)() {
         return 0;
 	}
 
-    byte_mode = is_mmc = false;
+    byte_mode = is_mmc = stream_open = meta_cmd17 = false;
+    memset(&profile, 0, sizeof(profile));
+    sd_meta_invalidate();
 
     /* Initialize interface with low speed for reliability */
     spi_init(spi1, 250 * 1000);
@@ -289,10 +365,11 @@ int __not_in_flash_func(sd_init)() {
     spi_set_cs(CS_OFF);
     spi_write_byte(SPI_FILL_CHAR);
 
-    /* Switch to maximum speed after successful initialization */
-	spi_set_baudrate(spi1, SD_BAUD_RATE);
-
+    /* Switch to the fastest clock the card handles reliably */
+	sd_dma_init();
     initted = true;
+    sd_set_speed();
+
     return 0;
 }
 
@@ -309,139 +386,592 @@ static int __not_in_flash_func(wait_nbsy)() {
 	return (byte != 0xFE);
 }
 
-static void __not_in_flash_func(read_data)(size_t bytes, uint8_t *buf) {
-    size_t i = 0;
-	size_t tx_remaining, rx_remaining;
-	
-	tx_remaining = rx_remaining = bytes;
-    
-    while (rx_remaining || tx_remaining) {
-        if (tx_remaining && spi_is_writable(spi1) && rx_remaining < tx_remaining + 8) {
-            spi_get_hw(spi1)->dr = (uint32_t) SPI_FILL_CHAR;
-            --tx_remaining;
+/* Blocks are clocked in by a DMA pair: TX repeats the fill byte from a non-incrementing source,
+   RX drains the FIFO into the destination. The 2 CRC bytes are picked up by the CPU afterwards. */
+static int dma_tx = -1;
+static int dma_rx = -1;
+static const uint8_t dma_fill = SPI_FILL_CHAR;
+static sd_read_stats_t read_stats;
+
+static void sd_dma_init(void) {
+    dma_channel_config c;
+
+    if(dma_rx >= 0) {
+        return;
+    }
+
+    dma_rx = dma_claim_unused_channel(true);
+
+#if SD_PIO_SPI
+    sd_spi_read_program_init(SD_PIO, SD_PIO_SM, pio_add_program(SD_PIO, &sd_spi_read_program),
+                             GPIO_SD_SCK, GPIO_SD_MOSI, GPIO_SD_MISO);
+
+    c = dma_channel_get_default_config(dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(SD_PIO, SD_PIO_SM, false));
+#if SD_DATA_CRC
+    channel_config_set_sniff_enable(&c, true);
+    dma_sniffer_enable(dma_rx, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
+#endif
+    dma_channel_configure(dma_rx, &c, NULL, &SD_PIO->rxf[SD_PIO_SM], 512, false);
+#else
+    dma_tx = dma_claim_unused_channel(true);
+
+    c = dma_channel_get_default_config(dma_tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, spi_get_dreq(spi1, true));
+    dma_channel_configure(dma_tx, &c, &spi_get_hw(spi1)->dr, &dma_fill, 512, false);
+
+    c = dma_channel_get_default_config(dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, spi_get_dreq(spi1, false));
+#if SD_DATA_CRC
+    channel_config_set_sniff_enable(&c, true);
+    dma_sniffer_enable(dma_rx, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
+#endif
+    dma_channel_configure(dma_rx, &c, NULL, &spi_get_hw(spi1)->dr, 512, false);
+#endif
+}
+
+#if SD_PIO_SPI
+static void __not_in_flash_func(sd_pins_to)(enum gpio_function func) {
+    gpio_set_function(GPIO_SD_SCK, func);
+    gpio_set_function(GPIO_SD_MOSI, func);
+    gpio_set_function(GPIO_SD_MISO, func);
+}
+#endif
+
+/* Data blocks are clocked at the SPI1 rate unless the PIO has its own */
+static uint32_t sd_set_baudrate(uint32_t baud) {
+    uint32_t actual = spi_set_baudrate(spi1, baud);
+
+#if SD_PIO_SPI
+    float div = (float) clock_get_hz(clk_sys) / (4.0f * baud);
+
+    if(div < 1.0f) {
+        div = 1.0f;
+    }
+
+    pio_sm_set_clkdiv(SD_PIO, SD_PIO_SM, div);
+    actual = (uint32_t) (clock_get_hz(clk_sys) / (4.0f * div));
+#endif
+
+    return actual;
+}
+
+static void __not_in_flash_func(read_block_start)(uint8_t *buf) {
+    dma_channel_set_write_addr(dma_rx, buf, false);
+    dma_channel_set_trans_count(dma_rx, 512, false);
+#if SD_DATA_CRC
+    dma_sniffer_set_data_accumulator(0);
+#endif
+#if SD_PIO_SPI
+    /* The data and the CRC behind it, the CPU picks the CRC bytes out of the FIFO */
+    dma_channel_start(dma_rx);
+    sd_pins_to(GPIO_FUNC_PIO1);
+    pio_sm_put(SD_PIO, SD_PIO_SM, (512 + 2) * 8 - 1);
+#else
+    dma_channel_set_trans_count(dma_tx, 512, false);
+    dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
+#endif
+}
+
+/* Returns non-zero when the block doesn't match its CRC */
+static int __not_in_flash_func(read_block_end)(void) {
+    uint64_t start = time_us_64();
+    uint16_t crc;
+
+    dma_channel_wait_for_finish_blocking(dma_rx);
+    read_stats.wait_us += time_us_64() - start;
+
+#if SD_PIO_SPI
+    crc = (pio_sm_get_blocking(SD_PIO, SD_PIO_SM) & 0xFF) << 8;
+    crc |= pio_sm_get_blocking(SD_PIO, SD_PIO_SM) & 0xFF;
+
+    /* SCK is back high once the last byte is pushed, same as SPI1 leaves it */
+    sd_pins_to(GPIO_FUNC_SPI);
+#else
+    crc = spi_read_byte() << 8;
+    crc |= spi_read_byte();
+#endif
+
+#if SD_DATA_CRC
+    return crc != (uint16_t) dma_sniffer_get_data_accumulator();
+#else
+    (void) crc;
+    return 0;
+#endif
+}
+
+const sd_read_stats_t *sd_get_read_stats(void) {
+    return &read_stats;
+}
+
+static void __not_in_flash_func(stream_close)(void) {
+    if(!stream_open) {
+        return;
+    }
+
+    stream_open = false;
+
+    /* Stop the data transfer */
+    sd_send_cmd(CMD(12), 0);
+
+    spi_set_cs(CS_OFF);
+    spi_write_byte(SPI_FILL_CHAR);
+}
+
+/* The read in progress. The DMA moves each block on its own, the CPU only steps in between
+   blocks for the start token, the CRC and the descrambling. */
+static struct {
+    bool busy;
+    bool in_flight;             /* DMA running for the current block */
+    int result;
+    uint32_t block;
+    size_t count;
+    uint8_t *buf;
+    const uint16_t *sc;
+    uint8_t *pending;           /* Block waiting to be descrambled */
+    const uint16_t *pending_sc;
+    int retries;
+    uint32_t token_polls;
+    bool single;                /* One block with CMD17 rather than a CMD18 stream */
+    bool single_open;           /* CMD17 sent, its block not in yet */
+    sd_read_cb_t cb;
+    void *ctx;
+} req;
+
+/* A CMD17 read stops by itself after its block, only the card select is left to release */
+static void __not_in_flash_func(single_close)(void) {
+    if(!req.single_open) {
+        return;
+    }
+
+    req.single_open = false;
+
+    spi_set_cs(CS_OFF);
+    spi_write_byte(SPI_FILL_CHAR);
+}
+
+static void __not_in_flash_func(read_finish)(int rv) {
+    if(req.pending) {
+        scramble_data((uint16_t *) req.pending, (uint16_t *) req.pending, req.pending_sc, 256);
+        req.pending = NULL;
+    }
+
+    /* Don't trust the stream position after an error */
+    if(rv) {
+        single_close();
+        stream_close();
+    }
+
+    req.result = rv;
+    req.busy = false;
+
+    if(req.cb) {
+        req.cb(rv, req.ctx);
+    }
+}
+
+/* Moves the read on as far as it goes without waiting, or to its end with wait set */
+static int __not_in_flash_func(read_step)(bool wait) {
+    uint64_t start = time_us_64();
+    uint8_t token;
+
+    while(req.busy) {
+        if(req.in_flight) {
+            if(!wait && dma_channel_is_busy(dma_rx)) {
+                break;
+            }
+
+            req.in_flight = false;
+
+            if(read_block_end()) {
+                /* The card has moved on, restart the stream at the bad block */
+                ++read_stats.crc_errors;
+                single_close();
+                stream_close();
+
+                if(++req.retries > CRC_RETRIES) {
+                    ++read_stats.crc_failures;
+                    read_finish(-1);
+                }
+                continue;
+            }
+
+            req.retries = 0;
+            read_stats.bytes += 512;
+            single_close();
+            ++stream_next;
+            ++req.block;
+            --req.count;
+
+            if(req.sc) {
+                req.pending = req.buf;
+                req.pending_sc = req.sc;
+                req.sc += 256;
+            }
+            req.buf += 512;
         }
-        
-        if (rx_remaining && spi_is_readable(spi1)) {
-			if(i > 511) {
-				(void) spi_get_hw(spi1)->dr;
-			}
-			else {
-				buf[i++] = (uint8_t) spi_get_hw(spi1)->dr;
-			}
-            --rx_remaining;
+
+        if(!req.count) {
+            read_finish(0);
+            break;
+        }
+
+        if(!stream_open && !req.single_open) {
+            spi_set_cs(CS_ON);
+
+            /* Ask the card for the blocks, scaled up if we're in byte addressing mode */
+            if(sd_send_cmd(req.single ? CMD(17) : CMD(18), byte_mode ? req.block << 9 : req.block)) {
+                spi_set_cs(CS_OFF);
+                spi_write_byte(SPI_FILL_CHAR);
+                read_finish(-1);
+                break;
+            }
+
+            if(req.single) {
+                req.single_open = true;
+            }
+            else {
+                stream_open = true;
+                stream_next = req.block;
+                ++read_stats.streams;
+            }
+            req.token_polls = 0;
+        }
+
+        /* The card sends 0xFF until the block is ready */
+        token = spi_read_byte();
+        if(token == 0xFF) {
+            if(++req.token_polls >= READ_RETRIES) {
+                read_finish(-1);
+                break;
+            }
+            if(!wait) {
+                break;
+            }
+            continue;
+        }
+
+        req.token_polls = 0;
+
+        if(token != 0xFE) {
+            read_finish(-1);
+            break;
+        }
+
+        read_block_start(req.buf);
+        req.in_flight = true;
+
+        /* Descramble the previous block while this one is on the wire */
+        if(req.pending) {
+            scramble_data((uint16_t *) req.pending, (uint16_t *) req.pending, req.pending_sc, 256);
+            req.pending = NULL;
         }
     }
+
+    read_stats.total_us += time_us_64() - start;
+
+    return req.busy ? 1 : req.result;
 }
 
-static void __not_in_flash_func(read_scrambled)(size_t bytes, uint32_t *buf, const uint16_t *sc, uint8_t dt) {
-    size_t i = 0;
-	size_t tx_remaining, rx_remaining;
-	uint16_t tmp;
-	uint8_t *tmpb = (uint8_t *) &tmp;
-	tx_remaining = rx_remaining = bytes;
-    
-    while (rx_remaining || tx_remaining) {
-        if (tx_remaining && spi_is_writable(spi1) && rx_remaining < tx_remaining + 8) {
-            spi_get_hw(spi1)->dr = (uint32_t) SPI_FILL_CHAR;
-            --tx_remaining;
+static int __not_in_flash_func(read_start)(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt,
+                                           bool single, sd_read_cb_t cb, void *ctx) {
+    if(!initted) {
+        return -1;
+    }
+
+    /* One read at a time on the bus */
+    while(req.busy) {
+        read_step(true);
+    }
+
+    /* Seek or cluster discontinuity, the open stream is no use */
+    if(stream_open && block != stream_next) {
+        stream_close();
+    }
+
+    req.busy = true;
+    req.in_flight = false;
+    req.block = block;
+    req.count = count;
+    req.buf = buf;
+    /* Only data tracks are descrambled, CDDA lands as it is */
+    req.sc = dt ? sc : NULL;
+    req.pending = NULL;
+    req.retries = 0;
+    req.token_polls = 0;
+    /* A block the open stream is about to deliver is cheaper to take from it */
+    req.single = single && count == 1 && !stream_open;
+    req.single_open = false;
+    req.cb = cb;
+    req.ctx = ctx;
+
+    read_step(false);
+
+    return 0;
+}
+
+int __not_in_flash_func(sd_read_start)(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt,
+                                       sd_read_cb_t cb, void *ctx) {
+    return read_start(block, count, buf, sc, dt, false, cb, ctx);
+}
+
+int __not_in_flash_func(sd_read_poll)(void) {
+    return read_step(false);
+}
+
+void __not_in_flash_func(sd_stream_close)(void) {
+    while(req.busy) {
+        read_step(true);
+    }
+
+    stream_close();
+}
+
+static int __not_in_flash_func(read_blocks)(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt,
+                                            bool single) {
+    if(read_start(block, count, buf, sc, dt, single, NULL, NULL)) {
+        return -1;
+    }
+
+    return read_step(true);
+}
+
+int __not_in_flash_func(sd_read_blocks)(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt) {
+    return read_blocks(block, count, buf, sc, dt, false);
+}
+
+/* Reads a register or status block that comes back as a data block (CMD6, CMD9, CMD10) */
+static int read_reg(uint8_t cmd, uint32_t arg, uint8_t *buf, size_t bytes) {
+    int rv = 0;
+
+    spi_set_cs(CS_ON);
+
+    if(sd_send_cmd(cmd, arg) || wait_nbsy()) {
+        rv = -1;
+    }
+    else {
+        while(bytes--) {
+            *buf++ = spi_read_byte();
         }
-        
-        if (rx_remaining && spi_is_readable(spi1)) {
-			if(i > 511) {
-				(void) spi_get_hw(spi1)->dr;
-			}
-			else {
-				tmpb[i & 1] = (uint8_t) spi_get_hw(spi1)->dr;
-				
-				if (i & 1) {
-					uint32_t i2sData;
-					if (dt) {
-						i2sData = (tmp ^ *sc++) << 8;
-					}
-					else {
-						i2sData = tmp << 8;
-					}
-					
-					if (i2sData & 0x100) {
-						i2sData |= 0xFF;
-					}
-
-					*buf++ = i2sData;
-				}
-			}
-			++i;
-            --rx_remaining;
+
+        /* Skip the CRC */
+        spi_read_byte();
+        spi_read_byte();
+    }
+
+    spi_set_cs(CS_OFF);
+    spi_write_byte(SPI_FILL_CHAR);
+
+    return rv;
+}
+
+/* CMD6: query function group 1, then switch it to high speed (function 1) */
+static bool sd_switch_hs(void) {
+    uint8_t status[64];
+
+    /* MMC has no CMD6, SDv1.0 cards reject it as an illegal command */
+    if(is_mmc) {
+        return false;
+    }
+
+    if(read_reg(CMD(6), 0x00FFFFF1, status, sizeof(status)) || !(status[13] & 0x02)) {
+        return false;
+    }
+
+    if(read_reg(CMD(6), 0x80FFFFF1, status, sizeof(status)) || (status[16] & 0x0F) != 1) {
+        return false;
+    }
+
+    return true;
+}
+
+/* A rate is good when a run of blocks comes back without a single CRC error */
+static bool probe_baud(uint32_t baud) {
+    uint32_t crc_errors = read_stats.crc_errors;
+    uint32_t i;
+
+    sd_set_baudrate(baud);
+
+    for(i = 0; i < PROBE_BLOCKS; ++i) {
+        if(sd_read_blocks(i, 1, probe_buf, NULL, 0)) {
+            break;
         }
     }
+
+    sd_stream_close();
+
+    return i == PROBE_BLOCKS && read_stats.crc_errors == crc_errors;
 }
 
-int __not_in_flash_func(sd_read_blocks)(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt) {
+static void sd_set_speed(void) {
+    const sd_read_stats_t stats = read_stats;
+    uint32_t max_baud;
+    size_t i;
+
+    memset(&card, 0, sizeof(card));
+    read_reg(CMD(10), 0, card.cid, sizeof(card.cid));
+
+    card.high_speed = sd_switch_hs();
+    max_baud = card.high_speed ? SD_HS_BAUD_RATE : SD_BAUD_RATE;
+
+    for(i = 0; i < KNOWN_CARDS; ++i) {
+        if(known_cards[i].baud && !memcmp(known_cards[i].cid, card.cid, sizeof(card.cid))) {
+            card.baud = sd_set_baudrate(known_cards[i].baud);
+            return;
+        }
+    }
+
+#if SD_DATA_CRC
+    /* Without a rung that passes the card gets the slowest one */
+    for(i = 0; i < sizeof(baud_ladder) / sizeof(baud_ladder[0]) - 1; ++i) {
+        if(baud_ladder[i] <= max_baud && probe_baud(baud_ladder[i])) {
+            break;
+        }
+    }
+
+    /* The probe's errors are expected, keep them out of the counters */
+    read_stats = stats;
+
+    card.baud = sd_set_baudrate(baud_ladder[i]);
+#else
+    /* No CRC to judge a rate by, run at the highest one the card is rated for */
+    (void) stats;
+    card.baud = sd_set_baudrate(max_baud);
+#endif
+
+    memcpy(known_cards[known_next].cid, card.cid, sizeof(card.cid));
+    known_cards[known_next].baud = card.baud;
+    known_next = (known_next + 1) % KNOWN_CARDS;
+}
+
+const sd_card_info_t *sd_get_card_info(void) {
+    return &card;
+}
+
+/* Random block in the profiled range, aligned to a 4K read */
+static uint32_t profile_block(uint32_t first, uint32_t count, uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return first + ((*seed >> 8) % (count / 8)) * 8;
+}
+
+int sd_profile_card(uint32_t first, uint32_t count) {
+    const sd_read_stats_t stats = read_stats;
+    uint32_t seed = 1, block, i, j;
+    uint64_t start, us, total = 0;
     int rv = 0;
 
-    if(!initted) {
+    if(!initted || count < PROFILE_SEQ_BLOCKS) {
         return -1;
     }
 
-    /* If we're in byte addressing mode, scale the block up. */
-    if(byte_mode) {
-        block <<= 9;
-	}
+    memset(&profile, 0, sizeof(profile));
+    sd_stream_close();
 
-    spi_set_cs(CS_ON);
+    /* Sequential: one stream, the way a track plays */
+    start = time_us_64();
+    for(i = 0; i < PROFILE_SEQ_BLOCKS && !rv; ++i) {
+        rv = sd_read_blocks(first + i, 1, probe_buf, NULL, 0);
+    }
+    sd_stream_close();
+    us = time_us_64() - start;
+    profile.seq_kbps = us ? (uint32_t) ((uint64_t) PROFILE_SEQ_BLOCKS * 500000 / us) : 0;
 
-    if(count == 1) {
-        /* Ask the card for the block */
-        if(sd_send_cmd(CMD(17), block)) {
-            rv = -1;
-            goto out;
+    /* Random 4K: what a seek costs before the stream is going again */
+    for(i = 0; i < PROFILE_SAMPLES && !rv; ++i) {
+        block = profile_block(first, count, &seed);
+
+        start = time_us_64();
+        for(j = 0; j < 8 && !rv; ++j) {
+            rv = sd_read_blocks(block + j, 1, probe_buf, NULL, 0);
         }
-        
-		if(wait_nbsy()) {
-			rv = -1;
-            goto out;
-		}
+        sd_stream_close();
+        us = time_us_64() - start;
 
-        /* Read the block back */
-        if (!sc) {
-			read_data(514, buf);
-		}
-		else {
-			read_scrambled(514, (uint32_t *) buf, sc, dt);
-		}
+        total += us;
+        if(us > profile.rand_max_us) {
+            profile.rand_max_us = (uint32_t) us;
+        }
     }
-    else {
-        /* Set up the multi-block read */
-        if(sd_send_cmd(CMD(18), block)) {
-            rv = -1;
-            goto out;
+    profile.rand_us = (uint32_t) (total / PROFILE_SAMPLES);
+
+    /* One isolated block with either command, CMD18 paying for the CMD12 that stops it */
+    for(i = 0, total = 0; i < PROFILE_SAMPLES && !rv; ++i) {
+        start = time_us_64();
+        rv = read_blocks(profile_block(first, count, &seed), 1, probe_buf, NULL, 0, true);
+        total += time_us_64() - start;
+    }
+    profile.cmd17_us = (uint32_t) (total / PROFILE_SAMPLES);
+
+    for(i = 0, total = 0; i < PROFILE_SAMPLES && !rv; ++i) {
+        start = time_us_64();
+        rv = sd_read_blocks(profile_block(first, count, &seed), 1, probe_buf, NULL, 0);
+        sd_stream_close();
+        total += time_us_64() - start;
+    }
+    profile.cmd18_us = (uint32_t) (total / PROFILE_SAMPLES);
+
+    /* The profile's reads aren't part of the workload */
+    read_stats = stats;
+
+    if(rv) {
+        memset(&profile, 0, sizeof(profile));
+        return -1;
+    }
+
+    meta_cmd17 = profile.cmd17_us < profile.cmd18_us;
+
+    return 0;
+}
+
+const sd_card_profile_t *sd_get_card_profile(void) {
+    return &profile;
+}
+
+static void sd_meta_invalidate(void) {
+    size_t i;
+
+    for(i = 0; i < SD_META_BLOCKS; ++i) {
+        meta_cache[i].last_use = 0;
+    }
+}
+
+static int __not_in_flash_func(sd_read_meta)(uint32_t block, uint8_t *buf) {
+    size_t i, victim = 0;
+
+    for(i = 0; i < SD_META_BLOCKS; ++i) {
+        if(meta_cache[i].last_use && meta_cache[i].block == block) {
+            meta_cache[i].last_use = ++meta_clock;
+            memcpy(buf, meta_cache[i].data, 512);
+            ++read_stats.meta_hits;
+            return 0;
         }
-        
-        while(count--) {
-			if(wait_nbsy()) {
-				rv = -1;
-				goto out;
-			}
-			
-			if (!sc) {
-				read_data(514, buf);
-				 buf += 512;
-			}
-			else {
-				read_scrambled(514, (uint32_t *) buf, sc, dt);
-				sc += 256;
-				buf += 1024;
-			}
+
+        if(meta_cache[i].last_use < meta_cache[victim].last_use) {
+            victim = i;
         }
+    }
 
-        /* Stop the data transfer */
-        sd_send_cmd(CMD(12), 0);
+    ++read_stats.meta_misses;
+
+    if(read_blocks(block, 1, meta_cache[victim].data, NULL, 0, meta_cmd17)) {
+        meta_cache[victim].last_use = 0;
+        return -1;
     }
 
-out:
-    spi_set_cs(CS_OFF);
-    spi_write_byte(SPI_FILL_CHAR);
+    meta_cache[victim].block = block;
+    meta_cache[victim].last_use = ++meta_clock;
+    memcpy(buf, meta_cache[victim].data, 512);
 
-    return rv;
+    return 0;
 }
 
 #if FF_FS_READONLY == 0
@@ -492,6 +1022,9 @@ int sd_write_blocks(uint32_t block, size_t count, const uint8_t *buf) {
         return -1;
     }
 
+    sd_stream_close();
+    sd_meta_invalidate();
+
     /* If we're in byte addressing mode, scale the block up. */
     if(byte_mode) {
         block <<= 9;
@@ -569,6 +1102,13 @@ DSTATUS __not_in_flash_func(disk_status)()
 /*-----------------------------------------------------------------------*/
 
 DSTATUS __not_in_flash_func(disk_initialize)() {
+    /* FatFs only asks when it (re)mounts the volume, and the card may have been swapped since.
+       Start over so the card is identified again and its rate looked up or probed. */
+    if(initted) {
+        sd_stream_close();
+        initted = false;
+    }
+
 	if(sd_init()) {
 		return RES_NOTRDY;
 	}
@@ -588,13 +1128,63 @@ DRESULT __not_in_flash_func(disk_read)( BYTE *buff,     /* Data buffer to store
 										BYTE  dt	    /* Data type */
 )
 {
-    if(sd_read_blocks(sector, count, buff, sc, dt)) {
+    if(count == 1 && !sc && !(dt & DT_STREAM)) {
+        if(sd_read_meta(sector, buff)) {
+            return RES_ERROR;
+        }
+
+        return RES_OK;
+    }
+
+    if(sd_read_blocks(sector, count, buff, sc, dt & ~DT_STREAM)) {
 		return RES_ERROR;
 	}
     
     return RES_OK;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Start reading Sector(s), completed by disk_poll                       */
+/*-----------------------------------------------------------------------*/
+
+static DISK_CB disk_cb;
+static void *disk_cb_ctx;
+
+static void __not_in_flash_func(disk_read_done)(int result, void *ctx) {
+    (void) ctx;
+
+    if(disk_cb) {
+        disk_cb(result ? RES_ERROR : RES_OK, disk_cb_ctx);
+    }
+}
+
+DRESULT __not_in_flash_func(disk_read_async)( BYTE *buff,     /* Data buffer to store read data */
+											  LBA_t sector,   /* Start sector in LBA */
+											  UINT  count,    /* Number of sectors to read */
+											  const WORD* sc, /* Buffer with scramble table */
+											  BYTE  dt,	      /* Data type */
+											  DISK_CB cb,     /* Called from disk_poll once the read is done */
+											  void* ctx
+)
+{
+    /* A read still in progress completes first, its callback must see its own context */
+    while(sd_read_poll() > 0) {
+    }
+
+    disk_cb = cb;
+    disk_cb_ctx = ctx;
+
+    if(sd_read_start(sector, count, buff, sc, dt & ~DT_STREAM, disk_read_done, NULL)) {
+        return RES_ERROR;
+    }
+
+    return RES_OK;
+}
+
+int __not_in_flash_func(disk_poll)(void) {
+    return sd_read_poll() > 0;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Write Sector(s)                                                       */
 /*-----------------------------------------------------------------------*/
@@ -650,6 +1240,7 @@ DRESULT __not_in_flash_func(disk_ioctl)(BYTE cmd,  /* Control code */
         }
         
         case CTRL_SYNC: {
+            sd_stream_close();
             return RES_OK;
 		}
         
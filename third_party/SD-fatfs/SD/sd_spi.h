@@ -0,0 +1,63 @@
+#ifndef _SD_SPI_DEFINED
+#define _SD_SPI_DEFINED
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Running totals for sd_read_blocks, for throughput and CPU load reporting */
+typedef struct {
+	uint64_t bytes;		/* Data bytes read from the card */
+	uint64_t total_us;	/* Time spent in sd_read_blocks */
+	uint64_t wait_us;	/* Part of it spent waiting on the DMA, free for other work */
+	uint32_t streams;	/* CMD18 streams opened, one per seek or discontinuity */
+	uint32_t crc_errors;	/* Blocks that failed their CRC16 and were read again */
+	uint32_t crc_failures;	/* Blocks still failing after all retries, returned as errors */
+	uint32_t meta_hits;	/* Metadata blocks served from the cache */
+	uint32_t meta_misses;	/* Metadata blocks read from the card */
+} sd_read_stats_t;
+
+const sd_read_stats_t *sd_get_read_stats(void);
+
+/* The mounted card and the SPI clock picked for it at mount */
+typedef struct {
+	uint8_t cid[16];	/* Card identification register */
+	uint32_t baud;		/* Actual SPI clock in Hz */
+	uint8_t high_speed;	/* Switched to high speed mode with CMD6 */
+} sd_card_info_t;
+
+const sd_card_info_t *sd_get_card_info(void);
+
+/* Read timings of the mounted card, all zero until sd_profile_card() has run */
+typedef struct {
+	uint32_t seq_kbps;	/* Sequential throughput in KB/s */
+	uint32_t rand_us;	/* Average random 4K read, stream opened and stopped */
+	uint32_t rand_max_us;	/* Slowest random 4K read */
+	uint32_t cmd17_us;	/* Isolated one block read with CMD17 */
+	uint32_t cmd18_us;	/* The same with a CMD18 stream opened and stopped for it */
+} sd_card_profile_t;
+
+/* Times reads spread over blocks first to first + count - 1, a few hundred blocks in all.
+   Metadata reads switch to CMD17 if it came out cheaper. */
+int sd_profile_card(uint32_t first, uint32_t count);
+const sd_card_profile_t *sd_get_card_profile(void);
+
+/* Ends the open multi-block read, if any. Reads reopen it on demand. */
+void sd_stream_close(void);
+
+/* Non-blocking reads, one at a time. sd_read_start() returns once the first block is under way
+   and sd_read_poll() moves the read on, returning 1 while it is in progress, then its result.
+   The callback, if any, runs from the poll that finishes the read. A blocking read started in
+   the meantime waits for this one first. */
+typedef void (*sd_read_cb_t)(int result, void *ctx);
+
+int sd_read_start(uint32_t block, size_t count, uint8_t *buf, const uint16_t *sc, uint8_t dt, sd_read_cb_t cb, void *ctx);
+int sd_read_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
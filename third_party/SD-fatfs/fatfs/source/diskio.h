@@ -32,6 +32,16 @@ DRESULT disk_read (BYTE* buff, LBA_t sector, UINT count, const WORD* sc, BYTE  d
 DRESULT disk_write (const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE cmd, void* buff);
 
+/* Non-blocking read, one at a time. disk_poll() moves it on and returns non-zero while it is in
+   progress; the callback runs from the poll that completes it. */
+typedef void (*DISK_CB)(DRESULT res, void* ctx);
+DRESULT disk_read_async (BYTE* buff, LBA_t sector, UINT count, const WORD* sc, BYTE dt, DISK_CB cb, void* ctx);
+int disk_poll (void);
+
+
+/* Data type flag for disk_read: file data read one sector at a time, kept out of the metadata cache */
+#define DT_STREAM		0x80
+
 
 /* Disk Status Bits (DSTATUS) */
 
@@ -1074,9 +1074,10 @@ static FRESULT __time_critical_func(sync_window) (	/* Returns FR_OK or FR_DISK_E
 #endif
 
 
-static FRESULT __time_critical_func(move_window) (	/* Returns FR_OK or FR_DISK_ERR */
+static FRESULT __time_critical_func(move_window_dt) (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS* fs,		/* Filesystem object */
-	LBA_t sect		/* Sector LBA to make appearance in the fs->win[] */
+	LBA_t sect,		/* Sector LBA to make appearance in the fs->win[] */
+	BYTE dt			/* 0: metadata, DT_STREAM: file data */
 )
 {
 	FRESULT res = FR_OK;
@@ -1087,7 +1088,7 @@ static FRESULT __time_critical_func(move_window) (	/* Returns FR_OK or FR_DISK_E
 		res = sync_window(fs);		/* Flush the window */
 #endif
 		if (res == FR_OK) {			/* Fill sector window with new data */
-			if (disk_read(fs->win, sect, 1, NULL, 0) != RES_OK) {
+			if (disk_read(fs->win, sect, 1, NULL, dt) != RES_OK) {
 				sect = (LBA_t)0 - 1;	/* Invalidate window if read data is not valid */
 				res = FR_DISK_ERR;
 			}
@@ -1097,6 +1098,8 @@ static FRESULT __time_critical_func(move_window) (	/* Returns FR_OK or FR_DISK_E
 	return res;
 }
 
+#define move_window(fs, sect) move_window_dt(fs, sect, 0)
+
 
 
 
@@ -3961,7 +3964,7 @@ FRESULT __time_critical_func(f_read) (
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
 				}
-				if (disk_read(rbuff, sect, cc, NULL, 0) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				if (disk_read(rbuff, sect, cc, NULL, DT_STREAM) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if FF_FS_TINY
 				if (fs->wflag && fs->winsect - sect < cc) {
@@ -3992,7 +3995,7 @@ FRESULT __time_critical_func(f_read) (
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
 #if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+		if (move_window_dt(fs, fp->sect, DT_STREAM) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
 		memcpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
 #else
 		memcpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
@@ -4007,26 +4010,58 @@ FRESULT __time_critical_func(f_read) (
 /*-----------------------------------------------------------------------*/
 /* Read File with scrambling                                             */
 /*-----------------------------------------------------------------------*/
-void __time_critical_func(scramble_data)(uint32_t *dst, uint16_t *src, const uint16_t *scramling, uint32_t len)
+typedef uint32_t __attribute__((may_alias)) sample_pair_t;	/* Two 16-bit samples */
+
+/* Data track kernel: XOR two samples per word, four words per pass, no per-sample branches */
+static inline __attribute__((always_inline)) void descramble_words(sample_pair_t *dst, const sample_pair_t *src, const sample_pair_t *lut, uint32_t words)
 {
-	while (len--)
+	while (words >= 4)
 	{
-		uint32_t tmp;
+		const uint32_t a = src[0], b = src[1], c = src[2], d = src[3];
 
-		if (scramling)
-		{
-			tmp = (uint32_t) (*src++ ^ *scramling++) << 8;
-		}
-		else
+		dst[0] = a ^ lut[0];
+		dst[1] = b ^ lut[1];
+		dst[2] = c ^ lut[2];
+		dst[3] = d ^ lut[3];
+		dst += 4;
+		src += 4;
+		lut += 4;
+		words -= 4;
+	}
+
+	while (words--)
+	{
+		*dst++ = *src++ ^ *lut++;
+	}
+}
+
+/* Data tracks, scramling must not be NULL */
+void __time_critical_func(scramble_data)(uint16_t *dst, uint16_t *src, const uint16_t *scramling, uint32_t len)
+{
+	/* Sector-sized reads keep all three buffers word aligned, anything else takes the slow path */
+	if ((((uintptr_t) dst | (uintptr_t) src | (uintptr_t) scramling) & 3) == 0)
+	{
+		descramble_words((sample_pair_t *) dst, (const sample_pair_t *) src, (const sample_pair_t *) scramling, len >> 1);
+
+		if (len & 1)
 		{
-			tmp = ((uint32_t) *src++) << 8;
+			dst[len - 1] = src[len - 1] ^ scramling[len - 1];
 		}
+		return;
+	}
 
-		if (tmp & 0x100) {
-			tmp |= 0xFF;
-		}
+	while (len--)
+	{
+		*dst++ = *src++ ^ *scramling++;
+	}
+}
 
-		*dst++ = tmp;
+/* CDDA: samples go out as they are on disc */
+void __time_critical_func(scramble_cdda)(uint16_t *dst, const uint16_t *src, uint32_t len)
+{
+	if (dst != src)
+	{
+		memcpy(dst, src, len << 1);
 	}
 }
 
@@ -4055,7 +4090,7 @@ FRESULT __time_critical_func(f_read_scramble) (
 	remain = fp->obj.objsize - fp->fptr;
 	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
 
-	for ( ; btr > 0; btr -= rcnt, *br += rcnt, rbuff += (rcnt << 1), fp->fptr += rcnt, sc += (rcnt >> 1)) {	/* Repeat until btr bytes read */
+	for ( ; btr > 0; btr -= rcnt, *br += rcnt, rbuff += rcnt, fp->fptr += rcnt, sc += (rcnt >> 1)) {	/* Repeat until btr bytes read */
 		if (fp->fptr % SS(fs) == 0) {			/* On the sector boundary? */
 			csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
 			if (csect == 0) {					/* On the cluster boundary? */
@@ -4088,21 +4123,15 @@ FRESULT __time_critical_func(f_read_scramble) (
 #if FF_FS_TINY
 				if (fs->wflag && fs->winsect - sect < cc) {
 					uint32_t dst_off = (fs->winsect - sect) * SS(fs);
-	scramble_data(
-    (uint32_t *)(rbuff + (dst_off << 1)),
-    (uint16_t *)fs->win,
-    dt ? sc + (dst_off >> 1) : NULL,
-    SS(fs) >> 1
-);				}
+					if (dt) scramble_data((uint16_t *)(rbuff + dst_off), (uint16_t *)fs->win, sc + (dst_off >> 1), SS(fs) >> 1);
+					else scramble_cdda((uint16_t *)(rbuff + dst_off), (uint16_t *)fs->win, SS(fs) >> 1);
+				}
 #else
 				if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
 					uint32_t dst_off = (fs->sect - sect) * SS(fs);
-					scramble_data(
-    (uint32_t *)(rbuff + (dst_off << 1)),
-    (uint16_t *)fs->buf,
-    dt ? sc + (dst_off >> 1) : NULL,
-    SS(fs) >> 1
-);	}
+					if (dt) scramble_data((uint16_t *)(rbuff + dst_off), (uint16_t *)fs->buf, sc + (dst_off >> 1), SS(fs) >> 1);
+					else scramble_cdda((uint16_t *)(rbuff + dst_off), (uint16_t *)fs->buf, SS(fs) >> 1);
+				}
 #endif
 #endif
 				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
@@ -4124,13 +4153,15 @@ FRESULT __time_critical_func(f_read_scramble) (
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
 #if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+		if (move_window_dt(fs, fp->sect, DT_STREAM) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
 		
 		/* Extract partial sector */
-		scramble_data((uint32_t *) rbuff, (uint16_t *) (fs->win + fp->fptr % SS(fs)), dt ? sc : NULL, rcnt >> 1);
+		if (dt) scramble_data((uint16_t *) rbuff, (uint16_t *) (fs->win + fp->fptr % SS(fs)), sc, rcnt >> 1);
+		else scramble_cdda((uint16_t *) rbuff, (uint16_t *) (fs->win + fp->fptr % SS(fs)), rcnt >> 1);
 #else
 		/* Extract partial sector */
-		scramble_data((uint32_t *) rbuff, (uint16_t *) (fp->buf + fp->fptr % SS(fs)), dt ? sc : NULL, rcnt >> 1);
+		if (dt) scramble_data((uint16_t *) rbuff, (uint16_t *) (fp->buf + fp->fptr % SS(fs)), sc, rcnt >> 1);
+		else scramble_cdda((uint16_t *) rbuff, (uint16_t *) (fp->buf + fp->fptr % SS(fs)), rcnt >> 1);
 #endif
 	}
 
@@ -4140,6 +4171,305 @@ FRESULT __time_critical_func(f_read_scramble) (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Read File through a staging area                                      */
+/*-----------------------------------------------------------------------*/
+/* All sectors covering the range are fetched with a single disk access
+/  into the staging area, then the requested slice is scrambled out of it.
+/  The last sector is kept, so a read continuing where the previous one
+/  ended only asks the disk for the sectors after it. With park set, the
+/  tail is parked there when a read elsewhere starts, so streams taking
+/  turns with the stage (e.g. a data track and a CDDA file) each find
+/  their own partial sector again. CDDA needs no scrambling, so the whole
+/  sectors of its slice are read straight into the caller's buffer and only
+/  the partial ones at either end go through the stage. Falls back to
+/  f_read_scramble() without a link map table, or when the range does not
+/  fit the staging area or is not contiguous on the volume.
+/  f_read_staged_async() returns once the disk read is under way; the file
+/  pointer and *br are final at once, the data and stage->res once
+/  disk_poll() has cleared stage->busy. Fallbacks complete before it returns. */
+
+static void __time_critical_func(stage_done) (
+	DRESULT dres,	/* Result of the disk read */
+	void* ctx		/* Staging area */
+)
+{
+	FSTAGE* stage = (FSTAGE*)ctx;
+	UINT head, tail;
+
+
+	if (dres == RES_OK) {
+		if (stage->direct) {			/* Only the ends of the slice are in buf, the head sector in slot 0 */
+			head = stage->ofs ? FF_MAX_SS - stage->ofs : 0;
+			tail = (stage->ofs + stage->len) % FF_MAX_SS;
+			if (head) memcpy(stage->dst, stage->buf + stage->ofs, head);
+			if (tail) memcpy((BYTE*)stage->dst + stage->len - tail, stage->buf + stage->tail_slot * FF_MAX_SS, tail);
+		} else if (stage->sc) {			/* sc is only set for data tracks */
+			scramble_data((uint16_t *) stage->dst, (uint16_t *) (stage->buf + stage->ofs), stage->sc, stage->len >> 1);
+		} else {
+			scramble_cdda((uint16_t *) stage->dst, (uint16_t *) (stage->buf + stage->ofs), stage->len >> 1);
+		}
+		stage->res = FR_OK;
+	} else {
+		stage->tail = 0;
+		stage->res = FR_DISK_ERR;
+	}
+	stage->busy = 0;
+}
+
+
+static DRESULT stage_read (FSTAGE* stage);
+
+/* Starts the next disk read of the slice, or finishes it once they are all in */
+static void __time_critical_func(stage_piece_done) (
+	DRESULT dres,	/* Result of the disk read */
+	void* ctx		/* Staging area */
+)
+{
+	FSTAGE* stage = (FSTAGE*)ctx;
+
+
+	if (dres == RES_OK && stage->next_piece < stage->npiece) {
+		if (stage_read(stage) == RES_OK) return;	/* Follows on from the last one, the stream stays open */
+		dres = RES_ERROR;
+	}
+	stage_done(dres, stage);
+}
+
+
+static DRESULT __time_critical_func(stage_read) (
+	FSTAGE* stage	/* Staging area with a read left to start */
+)
+{
+	UINT i = stage->next_piece++;
+
+
+	return disk_read_async(stage->piece[i].buf, stage->piece[i].sect, stage->piece[i].count, NULL, 0, stage_piece_done, stage);
+}
+
+
+/* Starts the disk read of cc contiguous sectors from sect into the stage,
+/  reusing the tail sector if it is the first one */
+static DRESULT __time_critical_func(stage_start) (
+	FSTAGE* stage,	/* Staging area, not busy */
+	LBA_t sect,		/* First volume sector */
+	UINT cc,		/* Number of sectors, up to stage->size */
+	UINT ofs,		/* Offset of the slice in the first sector */
+	void* buff,		/* Data buffer to store the slice */
+	UINT btr,		/* Slice length in bytes */
+	const WORD* sc,	/* Buffer with value for scrambling */
+	BYTE  dt		/* Reading data type. 0 = CDDA, 1 = data */
+)
+{
+	UINT skip = 0, i, w, head, mid;
+	DWORD *p, *q, t;
+
+
+	if (stage->tail == sect) {			/* First sector still staged from the previous read */
+		if (stage->tail_slot) memcpy(stage->buf, stage->buf + stage->tail_slot * FF_MAX_SS, FF_MAX_SS);
+		skip = 1;
+	} else if (stage->tail && stage->npark) {	/* Another stream, keep the tail for when it comes back */
+		for (i = 0; i < stage->npark && stage->park_sect[i] != sect; i++) ;
+		if (i < stage->npark) {			/* First sector parked by that stream, trade it for the tail */
+			p = (DWORD*)(stage->buf + stage->tail_slot * FF_MAX_SS);
+			q = (DWORD*)(stage->park + i * FF_MAX_SS);
+			for (w = 0; w < FF_MAX_SS / 4; w++) {
+				t = p[w]; p[w] = q[w]; q[w] = t;
+			}
+			if (stage->tail_slot) memcpy(stage->buf, stage->buf + stage->tail_slot * FF_MAX_SS, FF_MAX_SS);
+			skip = 1;
+		} else {						/* Evict the oldest parked sector */
+			i = stage->park_next;
+			stage->park_next = (i + 1) % stage->npark;
+			memcpy(stage->park + i * FF_MAX_SS, stage->buf + stage->tail_slot * FF_MAX_SS, FF_MAX_SS);
+		}
+		stage->park_sect[i] = stage->tail;
+	}
+	stage->dst = buff;
+	stage->ofs = ofs;
+	stage->len = btr;
+	stage->sc = dt ? sc : NULL;
+	stage->npiece = 0;
+	stage->next_piece = 0;
+
+	head = (ofs || skip) ? 1 : 0;			/* First sector goes through slot 0 */
+	w = ((ofs + btr) % FF_MAX_SS) ? 1 : 0;	/* Last sector is partial */
+	mid = cc - head - w;
+	stage->direct = !dt && cc > head + w;
+	if (stage->direct) {					/* CDDA, whole sectors go straight to buff */
+		if (head && !skip) {
+			stage->piece[stage->npiece].buf = stage->buf;
+			stage->piece[stage->npiece].sect = sect;
+			stage->piece[stage->npiece++].count = 1;
+		}
+		stage->piece[stage->npiece].buf = (BYTE*)buff + (head ? FF_MAX_SS - ofs : 0);
+		stage->piece[stage->npiece].sect = sect + head;
+		stage->piece[stage->npiece++].count = mid;
+		if (w) {
+			stage->piece[stage->npiece].buf = stage->buf + head * FF_MAX_SS;
+			stage->piece[stage->npiece].sect = sect + cc - 1;
+			stage->piece[stage->npiece++].count = 1;
+		}
+		stage->tail = w ? sect + cc - 1 : 0;	/* Nothing to keep when the slice ends on a sector */
+		stage->tail_slot = head;
+	} else {
+		if (cc > skip) {
+			stage->piece[0].buf = stage->buf + skip * FF_MAX_SS;
+			stage->piece[0].sect = sect + skip;
+			stage->piece[0].count = cc - skip;
+			stage->npiece = 1;
+		}
+		stage->tail = sect + cc - 1;
+		stage->tail_slot = cc - 1;
+	}
+	stage->busy = 1;
+
+	if (stage->npiece) {
+		if (stage_read(stage) != RES_OK) {
+			stage->busy = 0;
+			stage->tail = 0;
+			return RES_ERROR;
+		}
+	} else {
+		stage_done(RES_OK, stage);		/* Everything was staged already */
+	}
+	return RES_OK;
+}
+
+
+FRESULT __time_critical_func(f_read_staged_async) (
+	FIL* fp, 		/* Open file to be read */
+	FSTAGE* stage,	/* Staging area */
+	void* buff,		/* Data buffer to store the read data */
+	UINT btr,		/* Number of bytes to read */
+	UINT* br,		/* Number of bytes read */
+	const WORD* sc,	/* Buffer with value for scrambling */
+	BYTE  dt		/* Reading data type. 0 = CDDA, 1 = data */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst;
+	LBA_t sect, esect;
+	FSIZE_t remain, last;
+	UINT ofs, cc;
+
+
+	while (stage->busy) disk_poll();			/* One staged read at a time */
+	stage->res = FR_OK;
+
+	*br = 0;	/* Clear read byte counter */
+	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
+	remain = fp->obj.objsize - fp->fptr;
+	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
+	if (btr == 0) LEAVE_FF(fs, FR_OK);
+
+	ofs = (UINT)(fp->fptr % SS(fs));
+	cc = (ofs + btr + SS(fs) - 1) / SS(fs);		/* Number of sectors covering the range */
+#if FF_USE_FASTSEEK
+	if (fp->cltbl && cc <= stage->size) {
+		last = fp->fptr + btr - 1;
+		clst = clmt_clust(fp, fp->fptr);		/* First and last sector from the CLMT */
+		sect = clst2sect(fs, clst);
+		if (sect == 0) ABORT(fs, FR_INT_ERR);
+		sect += (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));
+		clst = clmt_clust(fp, last);
+		esect = clst2sect(fs, clst);
+		if (esect == 0) ABORT(fs, FR_INT_ERR);
+		esect += (UINT)(last / SS(fs) & (fs->csize - 1));
+
+		if (esect - sect == cc - 1) {			/* Contiguous on the volume? */
+			if (stage_start(stage, sect, cc, ofs, buff, btr, sc, dt) != RES_OK) ABORT(fs, FR_DISK_ERR);
+
+			fp->fptr += btr;
+			fp->clust = clst;
+			fp->sect = esect;
+			*br = btr;
+			LEAVE_FF(fs, FR_OK);
+		}
+	}
+#endif
+
+	res = f_read_scramble(fp, buff, btr, br, sc, dt);
+	stage->res = res;
+	return res;
+}
+
+
+FRESULT __time_critical_func(f_read_staged) (
+	FIL* fp, 		/* Open file to be read */
+	FSTAGE* stage,	/* Staging area */
+	void* buff,		/* Data buffer to store the read data */
+	UINT btr,		/* Number of bytes to read */
+	UINT* br,		/* Number of bytes read */
+	const WORD* sc,	/* Buffer with value for scrambling */
+	BYTE  dt		/* Reading data type. 0 = CDDA, 1 = data */
+)
+{
+	FRESULT res;
+
+
+	res = f_read_staged_async(fp, stage, buff, btr, br, sc, dt);
+	while (stage->busy) disk_poll();
+	return res == FR_OK ? stage->res : res;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Volume Sectors through a staging area                            */
+/*-----------------------------------------------------------------------*/
+/* Same as f_read_staged() for a range already resolved to the volume,
+/  e.g. with f_extent(). No file object and no FAT access; the range must
+/  be contiguous and fit the staging area. */
+
+FRESULT __time_critical_func(f_read_lba_async) (
+	FSTAGE* stage,	/* Staging area */
+	LBA_t sect,		/* Volume sector holding the first byte */
+	UINT ofs,		/* Offset of the first byte in that sector */
+	void* buff,		/* Data buffer to store the read data */
+	UINT btr,		/* Number of bytes to read */
+	const WORD* sc,	/* Buffer with value for scrambling */
+	BYTE  dt		/* Reading data type. 0 = CDDA, 1 = data */
+)
+{
+	UINT cc;
+
+
+	while (stage->busy) disk_poll();			/* One staged read at a time */
+	stage->res = FR_OK;
+
+	cc = (ofs + btr + FF_MAX_SS - 1) / FF_MAX_SS;	/* Number of sectors covering the range */
+	if (btr == 0 || ofs >= FF_MAX_SS || cc > stage->size) return FR_INVALID_PARAMETER;
+
+	return stage_start(stage, sect, cc, ofs, buff, btr, sc, dt) == RES_OK ? FR_OK : FR_DISK_ERR;
+}
+
+
+FRESULT __time_critical_func(f_read_lba) (
+	FSTAGE* stage,	/* Staging area */
+	LBA_t sect,		/* Volume sector holding the first byte */
+	UINT ofs,		/* Offset of the first byte in that sector */
+	void* buff,		/* Data buffer to store the read data */
+	UINT btr,		/* Number of bytes to read */
+	const WORD* sc,	/* Buffer with value for scrambling */
+	BYTE  dt		/* Reading data type. 0 = CDDA, 1 = data */
+)
+{
+	FRESULT res;
+
+
+	res = f_read_lba_async(stage, sect, ofs, buff, btr, sc, dt);
+	while (stage->busy) disk_poll();
+	return res == FR_OK ? stage->res : res;
+}
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Write File                                                            */
@@ -4245,7 +4575,7 @@ FRESULT __time_critical_func(f_write) (
 		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
 #if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+		if (move_window_dt(fs, fp->sect, DT_STREAM) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
 		memcpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
 		fs->wflag = 1;
 #else
@@ -4670,6 +5000,14 @@ FRESULT __time_critical_func(f_lseek) (
 #endif
 				fp->clust = clst;
 			}
+#if FF_FS_EXFAT
+			if (clst != 0 && fp->obj.stat == 2 && ofs > bcs && (FF_FS_READONLY || !(fp->flag & FA_WRITE))) {
+				clst += (DWORD)((ofs - 1) / bcs);		/* Contiguous (NoFatChain), no chain to follow */
+				fp->fptr += (ofs - 1) & ~(FSIZE_t)(bcs - 1);
+				ofs -= (ofs - 1) & ~(FSIZE_t)(bcs - 1);
+				fp->clust = clst;
+			}
+#endif
 			if (clst != 0) {
 				while (ofs > bcs) {						/* Cluster following loop */
 					ofs -= bcs; fp->fptr += bcs;
@@ -4723,6 +5061,128 @@ FRESULT __time_critical_func(f_lseek) (
 
 
 
+#if FF_USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Resolve a File Offset to the Volume                                   */
+/*-----------------------------------------------------------------------*/
+/* Looks the offset up in the link map table: the volume sector holding
+/  that byte, and how many bytes follow it up to the end of its fragment
+/  or of the file. The file pointer is left alone. A contiguous exFAT file
+/  needs no table, it is one fragment from its first cluster. */
+
+FRESULT f_extent (
+	FIL* fp,		/* Open file with a link map table or without a FAT chain */
+	FSIZE_t ofs,	/* File offset to resolve */
+	LBA_t* sect,	/* Volume sector holding the byte at ofs */
+	FSIZE_t* len	/* Bytes from ofs on without a break on the volume */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD cl, ncl, *tbl;
+	FSIZE_t csz;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	if (ofs >= fp->obj.objsize) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+
+	csz = (FSIZE_t)fs->csize * SS(fs);	/* Cluster size in bytes */
+#if FF_FS_EXFAT
+	if (fp->obj.stat == 2) {			/* Contiguous (NoFatChain), the whole file is one fragment */
+		*sect = clst2sect(fs, fp->obj.sclust + (DWORD)(ofs / csz));
+		if (*sect == 0) ABORT(fs, FR_INT_ERR);
+		*sect += (UINT)(ofs / SS(fs) & (fs->csize - 1));
+		*len = fp->obj.objsize - ofs;
+		LEAVE_FF(fs, FR_OK);
+	}
+#endif
+	if (!fp->cltbl) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+
+	tbl = fp->cltbl + 1;				/* Top of CLMT */
+	cl = (DWORD)(ofs / csz);			/* Cluster order from top of the file */
+	for (;;) {
+		ncl = *tbl++;					/* Number of cluters in the fragment */
+		if (ncl == 0) ABORT(fs, FR_INT_ERR);	/* End of table? (error) */
+		if (cl < ncl) break;			/* In this fragment? */
+		cl -= ncl; tbl++;				/* Next fragment */
+	}
+
+	*sect = clst2sect(fs, *tbl + cl);
+	if (*sect == 0) ABORT(fs, FR_INT_ERR);
+	*sect += (UINT)(ofs / SS(fs) & (fs->csize - 1));
+	*len = (FSIZE_t)(ncl - cl) * csz - ofs % csz;	/* Rest of the fragment */
+	if (*len > fp->obj.objsize - ofs) *len = fp->obj.objsize - ofs;
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Walk the Cluster Chain in Steps                                       */
+/*-----------------------------------------------------------------------*/
+/* Hands out the next run of clusters of the file on each call, following
+/  at most nclst links so the walk can be spread over idle time. A long
+/  fragment comes out in several pieces lying back to back. The piece is
+/  in scl, ncl, sect, ofs and len; len is 0 once the chain is done, and
+/  clst is 0 after the last piece. The file pointer is left alone. */
+
+FRESULT f_fragment (
+	FIL* fp,		/* Open file */
+	FFRAG* fg,		/* Walk state, zeroed before the first call */
+	UINT nclst		/* Number of links to follow at most */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD nxt, tcl;
+	FSIZE_t csz;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+	if (res != FR_OK) LEAVE_FF(fs, res);
+
+	fg->len = 0;
+	if (fg->clst == 0) {
+		if (fg->pos != 0 || fp->obj.sclust == 0 || fp->obj.objsize == 0) LEAVE_FF(fs, FR_OK);	/* Done or no chain */
+		fg->clst = fp->obj.sclust;		/* First call */
+	}
+
+	csz = (FSIZE_t)fs->csize * SS(fs);	/* Cluster size in bytes */
+	tcl = (DWORD)((fp->obj.objsize - 1) / csz) + 1;	/* Number of clusters in the file */
+	fg->scl = fg->clst; fg->ncl = 1;
+#if FF_FS_EXFAT
+	if (fp->obj.stat == 2) fg->ncl = tcl - fg->pos;	/* Contiguous (NoFatChain), the rest of the file is one piece */
+#endif
+	for (;;) {
+		if (fg->pos + fg->ncl >= tcl) {	/* Last cluster of the file? */
+			nxt = 0; break;
+		}
+		nxt = get_fat(&fp->obj, fg->scl + fg->ncl - 1);	/* Get next cluster */
+		if (nxt == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (nxt <= 1 || nxt >= fs->n_fatent) ABORT(fs, FR_INT_ERR);	/* Chain shorter than the file? */
+		if (nxt != fg->scl + fg->ncl || nclst <= 1) break;	/* Fragment ends or out of links */
+		fg->ncl++; nclst--;
+	}
+
+	fg->sect = clst2sect(fs, fg->scl);
+	if (fg->sect == 0) ABORT(fs, FR_INT_ERR);
+	fg->ofs = (FSIZE_t)fg->pos * csz;
+	fg->len = (FSIZE_t)fg->ncl * csz;
+	if (fg->len > fp->obj.objsize - fg->ofs) fg->len = fp->obj.objsize - fg->ofs;
+	fg->pos += fg->ncl;
+	fg->clst = nxt;						/* Where the next piece starts */
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif	/* FF_USE_FASTSEEK */
+
+
+
 #if FF_FS_MINIMIZE <= 1
 /*-----------------------------------------------------------------------*/
 /* Create a Directory Object                                             */
@@ -295,7 +295,51 @@ typedef enum {
 } FRESULT;
 
 
-void scramble_data(uint32_t *dst, uint16_t *src, const uint16_t *scramling, uint32_t len);
+
+/* Staging area for f_read_staged() */
+
+typedef struct {
+	BYTE*	buf;			/* Sector aligned buffer */
+	UINT	size;			/* Number of sectors buf holds */
+	LBA_t	tail;			/* Volume sector held in the last slot filled (0:none, set on reset) */
+	UINT	tail_slot;		/* Slot of buf holding the tail sector */
+	BYTE*	park;			/* Tail sectors of other streams, npark sectors (NULL:none) */
+	LBA_t*	park_sect;		/* Volume sector held in each of them (0:none, set on reset) */
+	UINT	npark;			/* Number of sectors park holds */
+	UINT	park_next;		/* Slot taken by the next tail parked */
+	volatile BYTE	busy;	/* Read started by f_read_staged_async() still in progress */
+	FRESULT	res;			/* Result of the last read once busy clears */
+	void*	dst;			/* Where the slice goes once the sectors are in */
+	UINT	ofs;			/* Offset of the slice in buf */
+	UINT	len;			/* Slice length in bytes */
+	const WORD*	sc;			/* Scramble table for the slice, NULL for none */
+	BYTE	direct;			/* Whole sectors of the slice went straight to dst, buf only holds its ends */
+	struct {
+		BYTE*	buf;
+		LBA_t	sect;
+		UINT	count;
+	} piece[3];				/* Disk reads of the slice, in volume order */
+	UINT	npiece;			/* Number of them */
+	UINT	next_piece;		/* Next one to start */
+} FSTAGE;
+
+
+
+/* Cluster chain walk for f_fragment() (zeroed before the first call) */
+
+typedef struct {
+	DWORD	clst;			/* First cluster of the next piece (0:chain done) */
+	DWORD	pos;			/* Clusters in the file before the next piece */
+	DWORD	scl;			/* First cluster of the piece handed out */
+	DWORD	ncl;			/* Number of clusters in it */
+	LBA_t	sect;			/* Its first sector */
+	FSIZE_t	ofs;			/* Its file offset */
+	FSIZE_t	len;			/* Its length in bytes (0:none, the chain is done) */
+} FFRAG;
+
+
+void scramble_data(uint16_t *dst, uint16_t *src, const uint16_t *scramling, uint32_t len);	/* Data tracks, XOR with the scrambling table */
+void scramble_cdda(uint16_t *dst, const uint16_t *src, uint32_t len);	/* CDDA, copied as it is */
 
 /*--------------------------------------------------------------*/
 /* FatFs Module Application Interface                           */
@@ -305,8 +349,14 @@ FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);				/* Open or create a f
 FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from the file */
 FRESULT f_read_scramble (FIL* fp, void* buff, UINT btr, UINT* br, const WORD* sc, BYTE  dt);	/* Read data from the file with scrambling */
+FRESULT f_read_staged (FIL* fp, FSTAGE* stage, void* buff, UINT btr, UINT* br, const WORD* sc, BYTE dt);	/* Read data through a staging area with one disk access */
+FRESULT f_read_staged_async (FIL* fp, FSTAGE* stage, void* buff, UINT btr, UINT* br, const WORD* sc, BYTE dt);	/* Start a staged read, done once disk_poll() clears stage->busy */
+FRESULT f_read_lba (FSTAGE* stage, LBA_t sect, UINT ofs, void* buff, UINT btr, const WORD* sc, BYTE dt);	/* Read a contiguous volume range through a staging area */
+FRESULT f_read_lba_async (FSTAGE* stage, LBA_t sect, UINT ofs, void* buff, UINT btr, const WORD* sc, BYTE dt);	/* Start it, done once disk_poll() clears stage->busy */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to the file */
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
+FRESULT f_extent (FIL* fp, FSIZE_t ofs, LBA_t* sect, FSIZE_t* len);	/* Resolve a file offset to the volume */
+FRESULT f_fragment (FIL* fp, FFRAG* fg, UINT nclst);				/* Follow the cluster chain a few links at a time */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
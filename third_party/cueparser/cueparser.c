@@ -38,6 +38,15 @@ SOFTWARE.
 
 #pragma GCC diagnostic ignored "-Wswitch"
 
+// The CueFile opened for each FILE line comes from malloc unless the build names another allocator.
+#ifdef CUEPARSER_FILE_ALLOC
+void* CUEPARSER_FILE_ALLOC(size_t size);
+void CUEPARSER_FILE_FREE(void* ptr);
+#else
+#define CUEPARSER_FILE_ALLOC malloc
+#define CUEPARSER_FILE_FREE free
+#endif
+
 enum Keyword {
     KW_EMPTY = 0x00001505,
     KW_4CH = 0x0b86667a,
@@ -348,7 +357,7 @@ static void parse(struct CueParser* parser, struct CueFile* file, struct CueSche
                     end_parse(parser, scheduler, "cuesheet FILE missing its filename argument");
                     return;
                 } else {
-                    struct CueFile* binaryFile = malloc(sizeof(struct CueFile));
+                    struct CueFile* binaryFile = CUEPARSER_FILE_ALLOC(sizeof(struct CueFile));
                     assert(binaryFile);
                     binaryFile->user = file;
                     if (parser->isTrackANewFile) {
@@ -365,7 +374,7 @@ static void parse(struct CueParser* parser, struct CueFile* file, struct CueSche
                     }
                     if (!parser->open(binaryFile, scheduler, parser->word)) {
                         binaryFile->destroy(binaryFile);
-                        free(binaryFile);
+                        CUEPARSER_FILE_FREE(binaryFile);
                         end_parse(parser, scheduler, "cuesheet references a file that can't be found");
                         return;
                     }
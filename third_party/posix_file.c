@@ -26,10 +26,71 @@ SOFTWARE.
 
 #include "posix_file.h"
 #include "ff.h"
+#include "cueparser/disc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Everything a mounted disc keeps comes from one fixed arena: a FIL and a CueFile per track file,
+   the cue sheet's own FIL, then the link map tables built once it is loaded. The extent table grows
+   down from the other end, so the two share whatever room is left. Nothing is freed on its own, the
+   whole arena goes back at once when the disc is unloaded. */
+#define ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+#define ARENA_SIZE ((MAXTRACK + 1) * (ARENA_ALIGN(sizeof(FIL)) + ARENA_ALIGN(sizeof(struct CueFile))) + \
+                    POSIX_FILE_TABLE_BYTES)
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(8)));
+static size_t arena_used = 0;
+static size_t arena_last = 0;	/* Offset of the last allocation, the only one that can grow */
+static size_t arena_top = ARENA_SIZE;	/* Start of what posix_file_alloc_top() handed out */
+
+void *posix_file_alloc(size_t size) {
+    size = ARENA_ALIGN(size);
+    if (size > arena_top - arena_used)
+	{
+		return NULL;
+	}
+	
+    arena_last = arena_used;
+    arena_used += size;
+    return &arena[arena_last];
+}
+
+void *posix_file_grow(void *ptr, size_t size) {
+    if (!ptr)
+	{
+		return posix_file_alloc(size);
+	}
+	
+    size = ARENA_ALIGN(size);
+    if ((uint8_t *)ptr != &arena[arena_last] || size > arena_top - arena_last)
+	{
+		return NULL;
+	}
+	
+    arena_used = arena_last + size;
+    return ptr;
+}
+
+void *posix_file_alloc_top(size_t size) {
+    size = ARENA_ALIGN(size);
+    if (size > arena_top - arena_used)
+	{
+		return NULL;
+	}
+	
+    arena_top -= size;
+    return &arena[arena_top];
+}
+
+void posix_file_free(void *ptr) {}
+
+void posix_file_reset(void) {
+    arena_used = 0;
+    arena_last = 0;
+    arena_top = ARENA_SIZE;
+}
+
 static void posix_destroy(struct CueFile *file) {}
 
 static void posix_close(struct CueFile *file, struct CueScheduler *scheduler, void (*cb)(struct CueFile *, struct CueScheduler *)) {
@@ -40,12 +101,7 @@ static void posix_close(struct CueFile *file, struct CueScheduler *scheduler, vo
 		return;
 	}
 	
-    if (fp->cltbl)
-    {
-		free(fp->cltbl);
-	}
     f_close(fp);
-    free(fp);
     
     if (scheduler)
 	{
@@ -65,7 +121,7 @@ static void posix_read(struct CueFile *file, struct CueScheduler *scheduler, uin
                        void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount, uint8_t *buffer)) {
     
     FIL *f = (FIL *)file->opaque;
-    size_t r;
+    UINT r;
     f_lseek(f, cursor);
     int ret = f_read(f, buffer, amount, &r);
     
@@ -77,7 +133,7 @@ static void posix_write(struct CueFile *file, struct CueScheduler *scheduler, ui
                         void (*cb)(struct CueFile *, struct CueScheduler *, int error, uint32_t amount)) {
 #if FF_FS_READONLY == 0
     FIL *f = (FIL *)file->opaque;
-    size_t r;
+    UINT r;
     f_lseek(f, cursor);
     int ret = f_write(f, buffer, amount, &r);
     
@@ -87,7 +143,10 @@ static void posix_write(struct CueFile *file, struct CueScheduler *scheduler, ui
 
 struct CueFile *create_posix_file(struct CueFile *file, const char *filename, uint8_t mode) {
     
-    FIL *fp = malloc(sizeof(FIL));
+    /* The parser destroys the file when this fails */
+    file->destroy = posix_destroy;
+    
+    FIL *fp = posix_file_alloc(sizeof(FIL));
     if (!fp)
 	{
 		return NULL;
@@ -95,38 +154,12 @@ struct CueFile *create_posix_file(struct CueFile *file, const char *filename, ui
 	
     if(f_open(fp, filename, mode))
     {
-		free(fp);
+		posix_file_free(fp);
 		return NULL;
 	}
     
-    DWORD cltbltmp = 1;
-    fp->cltbl = &cltbltmp;
-    
-    FRESULT r = f_lseek(fp, CREATE_LINKMAP);
-    
-    if (r == FR_NOT_ENOUGH_CORE)
-	{
-		size_t count = fp->cltbl[0];
-		DWORD *cltbl = (DWORD *)malloc(count * sizeof(DWORD));
-		
-		if (cltbl)
-		{
-			memset(cltbl, 0, count * sizeof(DWORD));
-			cltbl[0] = count;
-			fp->cltbl = cltbl;
-			r = f_lseek(fp, CREATE_LINKMAP);
-			
-			if(r != FR_OK)
-			{
-				free(cltbl);
-			}
-		}
-	}
-    
-    if(r != FR_OK)
-	{
-		fp->cltbl = NULL;
-	}
+    /* The link map table is left to the caller, built a few links at a time once the disc is up */
+    fp->cltbl = NULL;
     
     file->opaque = fp;
     file->destroy = posix_destroy;
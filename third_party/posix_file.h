@@ -26,14 +26,30 @@ SOFTWARE.
 
 #pragma once
 
+#include <stddef.h>
+
 #include "cueparser/fileabstract.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Room for the extent and link map tables on top of the per track file objects */
+#ifndef POSIX_FILE_TABLE_BYTES
+#define POSIX_FILE_TABLE_BYTES (12 * 1024)
+#endif
+
 struct CueFile* create_posix_file(struct CueFile*, const char* filename, uint8_t mode);
 
+/* Fixed arena behind the files of the mounted disc. Only the last allocation can grow, and
+   posix_file_free() is a no-op: the space comes back with posix_file_reset(). Blocks taken from
+   the top end sit right below each other, so they can be used as one array growing down. */
+void* posix_file_alloc(size_t size);
+void* posix_file_grow(void* ptr, size_t size);
+void* posix_file_alloc_top(size_t size);
+void posix_file_free(void* ptr);
+void posix_file_reset(void);
+
 #ifdef __cplusplus
 }
 #endif